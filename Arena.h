@@ -0,0 +1,115 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+using namespace std;
+
+// Bump allocator. Objects are carved out of large blocks and never freed one by one;
+// release() drops every block at once, so only trivially destructible types may live here.
+class Arena
+{
+private:
+    struct Block
+    {
+        Block *next;
+    };
+
+    Block *blocks = nullptr;
+    char *cursor = nullptr;
+    char *limit = nullptr;
+    size_t nextBlockSize = 64 * 1024;
+    size_t bytesUsed = 0;
+
+    // start a new block able to hold size bytes at any alignment
+    void grow(size_t size)
+    {
+        size_t blockSize = max(nextBlockSize, size + sizeof(Block) + alignof(max_align_t));
+        Block *block = static_cast<Block *>(malloc(blockSize));
+        if (block == nullptr)
+        {
+            throw bad_alloc();
+        }
+
+        block->next = blocks;
+        blocks = block;
+        cursor = reinterpret_cast<char *>(block + 1);
+        limit = reinterpret_cast<char *>(block) + blockSize;
+        nextBlockSize = blockSize * 2;
+    }
+
+public:
+    Arena() = default;
+
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+
+    ~Arena() { release(); }
+
+    void *allocate(size_t size, size_t align = alignof(max_align_t))
+    {
+        uintptr_t address = (reinterpret_cast<uintptr_t>(cursor) + align - 1) & ~(uintptr_t)(align - 1);
+        if (cursor == nullptr || address + size > reinterpret_cast<uintptr_t>(limit))
+        {
+            grow(size + align);
+            address = (reinterpret_cast<uintptr_t>(cursor) + align - 1) & ~(uintptr_t)(align - 1);
+        }
+
+        cursor = reinterpret_cast<char *>(address + size);
+        bytesUsed += size;
+        return reinterpret_cast<void *>(address);
+    }
+
+    template <typename T, typename... Args>
+    T *create(Args &&...args)
+    {
+        static_assert(is_trivially_destructible<T>::value, "arena objects are never destroyed");
+        return new (allocate(sizeof(T), alignof(T))) T(forward<Args>(args)...);
+    }
+
+    // uninitialized array of count elements
+    template <typename T>
+    T *allocateArray(size_t count)
+    {
+        return static_cast<T *>(allocate(sizeof(T) * count, alignof(T)));
+    }
+
+    // copy of a string that lives as long as the arena
+    string_view copy(string_view text)
+    {
+        if (text.empty())
+        {
+            return string_view();
+        }
+        char *data = static_cast<char *>(allocate(text.size(), 1));
+        memcpy(data, text.data(), text.size());
+        return string_view(data, text.size());
+    }
+
+    // bytes handed out since the last release
+    size_t bytesAllocated() const { return bytesUsed; }
+
+    // free every block; everything allocated from the arena becomes invalid
+    void release()
+    {
+        while (blocks != nullptr)
+        {
+            Block *next = blocks->next;
+            free(blocks);
+            blocks = next;
+        }
+        cursor = nullptr;
+        limit = nullptr;
+        nextBlockSize = 64 * 1024;
+        bytesUsed = 0;
+    }
+};
+
+#endif // ARENA_H
@@ -5,115 +5,106 @@ using namespace std;
 using std::invalid_argument;
 using std::out_of_range;
 
-string op(string type, string a, string b)
+long long op(const string &type, long long a, long long b)
 {
-    int num_a = stoi(a);
-    int num_b = stoi(b);
-
-    int result;
+    long long result;
 
     if (type == "+")
     {
-        result = num_a + num_b;
+        result = a + b;
     }
     else if (type == "-")
     {
-        result = num_a - num_b;
+        result = a - b;
     }
     else if (type == "*")
     {
-        result = num_a * num_b;
+        result = a * b;
     }
     else if (type == "/")
     {
-        if (num_b == 0)
+        if (b == 0)
         {
             throw runtime_error("Division by zero is not allowed.");
         }
-        result = num_a / num_b;
+        result = a / b;
     }
     else
     {
         throw invalid_argument("Invalid operator: " + type);
     }
-    return to_string(result);
+    return result;
 }
 
-string unop(string type, string a)
+long long unop(const string &type, long long a)
 {
     if (type == "neg")
     {
-        return to_string(-(stoi(a)));
+        return -a;
     }
     else if (type == "not")
     {
-        if (a == "true")
-        {
-            return "false";
-        }
-        else if (a == "false")
-        {
-            return "true";
-        }
+        return a == 0;
     }
 
-    // If the 'type' is not valid or 'a' is not "true" or "false", throw an exception.
-    throw invalid_argument("Invalid operator or operand: " + type + ", " + a);
+    // If the 'type' is not valid, throw an exception.
+    throw invalid_argument("Invalid operator or operand: " + type + ", " + to_string(a));
 }
 
-string booleanops(string type, string a, string b)
+bool booleanops(const string &type, long long a, long long b)
 {
 
     if (type == "or")
     {
-        return (a == "true" || b == "true") ? "true" : "false";
+        return a != 0 || b != 0;
     }
     if (type == "&")
     {
-        return (a == "true" && b == "true") ? "true" : "false";
-    }
-
-    int num_a, num_b;
-    try
-    {
-        num_a = stoi(a);
-        num_b = stoi(b);
-    }
-    catch (const invalid_argument &e)
-    {
-        throw invalid_argument("Invalid numeric inputs.");
-    }
-    catch (const out_of_range &e)
-    {
-        throw out_of_range("Numeric inputs out of range.");
+        return a != 0 && b != 0;
     }
 
     if (type == "eq")
     {
-        return (num_a == num_b) ? "true" : "false";
+        return a == b;
     }
     else if (type == "ne")
     {
-        return (num_a != num_b) ? "true" : "false";
+        return a != b;
     }
     else if (type == "gr")
     {
-        return (num_a > num_b) ? "true" : "false";
+        return a > b;
     }
     else if (type == "ls")
     {
-        return (num_a < num_b) ? "true" : "false";
+        return a < b;
     }
     else if (type == "ge")
     {
-        return (num_a >= num_b) ? "true" : "false";
+        return a >= b;
     }
     else if (type == "le")
     {
-        return (num_a <= num_b) ? "true" : "false";
+        return a <= b;
     }
     else
     {
         throw invalid_argument("Invalid operator: " + type);
     }
 }
+
+bool stringops(const string &type, string_view a, string_view b)
+{
+    if (type == "eq")
+    {
+        return a == b;
+    }
+    else if (type == "ne")
+    {
+        return a != b;
+    }
+    else
+    {
+        throw invalid_argument("Invalid operator for strings: " + type);
+    }
+}
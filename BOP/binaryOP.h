@@ -1,11 +1,13 @@
 #include <string>
+#include <string_view>
 using namespace std;
 
 #ifndef BIOPS_H
 #define BIOPS_H
 
-string op(string type, string a, string b);
-string unop(string type, string a);
-string booleanops(string type, string a, string b);
+long long op(const string &type, long long a, long long b);
+long long unop(const string &type, long long a);
+bool booleanops(const string &type, long long a, long long b);
+bool stringops(const string &type, string_view a, string_view b);
 
 #endif
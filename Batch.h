@@ -0,0 +1,213 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Interpreter.h"
+#include "ProgramCache.h"
+#include "SourceFile.h"
+
+using namespace std;
+
+// Runs a fixed set of numbered tasks on a pool of threads.
+// Each worker owns a deque of task numbers: it takes work from the back of its own deque and,
+// when that runs dry, steals from the front of another worker's, so a few slow programs do
+// not hold up the rest of their share.
+class WorkStealingPool
+{
+private:
+    struct Queue
+    {
+        mutex lock;
+        deque<size_t> tasks;
+    };
+
+    vector<Queue> queues;
+
+    // next task of worker self, stolen from another worker if its own deque is empty
+    bool nextTask(size_t self, size_t &task)
+    {
+        {
+            lock_guard<mutex> guard(queues[self].lock);
+            if (!queues[self].tasks.empty())
+            {
+                task = queues[self].tasks.back();
+                queues[self].tasks.pop_back();
+                return true;
+            }
+        }
+
+        for (size_t offset = 1; offset < queues.size(); ++offset)
+        {
+            Queue &victim = queues[(self + offset) % queues.size()];
+            lock_guard<mutex> guard(victim.lock);
+            if (!victim.tasks.empty())
+            {
+                task = victim.tasks.front();
+                victim.tasks.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+public:
+    explicit WorkStealingPool(size_t workers) : queues(max<size_t>(workers, 1)) {}
+
+    size_t workerCount() const { return queues.size(); }
+
+    // run work(worker, task) for every task in [0, taskCount); returns when all have finished
+    void run(size_t taskCount, const function<void(size_t, size_t)> &work)
+    {
+        // no task is added once the workers start, so an empty pool means the work is done
+        for (size_t task = 0; task < taskCount; ++task)
+        {
+            queues[task % queues.size()].tasks.push_front(task);
+        }
+
+        size_t threadCount = min(queues.size(), taskCount);
+        vector<thread> threads;
+        for (size_t worker = 1; worker < threadCount; ++worker)
+        {
+            threads.emplace_back([this, worker, &work]
+                                 {
+                                     size_t task;
+                                     while (nextTask(worker, task))
+                                     {
+                                         work(worker, task);
+                                     } });
+        }
+
+        // the calling thread is worker 0
+        size_t task;
+        while (threadCount > 0 && nextTask(0, task))
+        {
+            work(0, task);
+        }
+        for (thread &worker : threads)
+        {
+            worker.join();
+        }
+    }
+};
+
+// Outcome of one program of a batch
+struct BatchResult
+{
+    string path;
+    string output; // what the program printed, followed by its error if it failed
+    bool failed = false;
+    double millis = 0; // wall time from opening the file to the end of evaluation
+};
+
+// Programs named by a batch argument: the files of a directory, sorted by name, or the
+// paths listed one per line in a list file. Blank lines and lines starting with # are skipped.
+// Throws when the argument cannot be read.
+inline vector<string> batchPrograms(const string &argument)
+{
+    namespace fs = std::filesystem;
+    vector<string> paths;
+
+    if (fs::is_directory(argument))
+    {
+        for (const fs::directory_entry &entry : fs::directory_iterator(argument))
+        {
+            string name = entry.path().filename().string();
+            // skip hidden files and the notes that live next to test programs
+            if (!entry.is_regular_file() || name[0] == '.' || entry.path().extension() == ".md")
+            {
+                continue;
+            }
+            paths.push_back(entry.path().string());
+        }
+        sort(paths.begin(), paths.end());
+        return paths;
+    }
+
+    ifstream list(argument);
+    if (!list.is_open())
+    {
+        throw runtime_error("Unable to open batch: " + argument);
+    }
+
+    string line;
+    while (getline(list, line))
+    {
+        if (!line.empty() && line.back() == '\r')
+        {
+            line.pop_back();
+        }
+        if (!line.empty() && line[0] != '#')
+        {
+            paths.push_back(line);
+        }
+    }
+    return paths;
+}
+
+// Run every program on the pool with one interpreter per worker, sharing cache when it is not null.
+// Results come back in the order of paths whatever order the programs finish in.
+inline vector<BatchResult> runBatch(const vector<string> &paths, size_t workers, bool useBytecode,
+                                    ProgramCache *cache = nullptr)
+{
+    vector<BatchResult> results(paths.size());
+    WorkStealingPool pool(workers);
+    vector<unique_ptr<Interpreter>> interpreters;
+    for (size_t worker = 0; worker < pool.workerCount(); ++worker)
+    {
+        interpreters.push_back(make_unique<Interpreter>(useBytecode));
+        interpreters.back()->setCache(cache);
+    }
+
+    pool.run(paths.size(), [&](size_t worker, size_t task)
+             {
+                 BatchResult &result = results[task];
+                 result.path = paths[task];
+                 chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+                 string error;
+                 SourceFile source;
+                 if (!source.open(result.path))
+                 {
+                     error = "Unable to open file: " + result.path;
+                 }
+                 else
+                 {
+                     try
+                     {
+                         interpreters[worker]->load(source.view());
+                         interpreters[worker]->execute(result.output);
+                     }
+                     catch (const exception &exception)
+                     {
+                         error = string("Error: ") + exception.what();
+                     }
+                 }
+
+                 // keep what the program printed before it failed
+                 if (!error.empty())
+                 {
+                     if (!result.output.empty() && result.output.back() != '\n')
+                     {
+                         result.output += '\n';
+                     }
+                     result.output += error + "\n";
+                     result.failed = true;
+                 }
+                 result.millis = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count(); });
+
+    return results;
+}
+
+#endif // BATCH_H
@@ -0,0 +1,407 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include <vector>
+#include <string>
+#include <string_view>
+#include <memory>
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <stdexcept>
+#include "TreeNode.h"
+#include "SymbolTable.h"
+#include "SourceMap.h"
+
+using namespace std;
+
+// version of the instruction set and its encoding; bump it when either changes so that
+// programs compiled by an older interpreter are not run
+constexpr int BYTECODE_VERSION = 3;
+
+// instruction set of the bytecode CSE machine
+enum class Opcode : unsigned char
+{
+    PUSH_INT,    // a: integer constant index
+    PUSH_STR,    // a: string constant index
+    LOAD,        // a: depth (-1 when free), b: slot, c: name index
+    PUSH_LAMBDA, // a: block index
+    GAMMA,  // b: 1 in tail position
+    TAU,    // a: arity
+    BRANCH, // a: pc of then block, b: pc of else block
+    ADD,
+    SUB,
+    MUL,
+    DIV,
+    EQ,
+    NE,
+    GR,
+    GE,
+    LS,
+    LE,
+    OR,
+    AND,
+    AUG,
+    NEG,
+    NOT,
+    END,      // leave a conditional branch
+    EXIT_ENV, // leave a lambda body and its environment
+    HALT
+};
+
+// opcode of an operator node; false when the node is not an operator
+inline bool operatorOpcode(NodeKind kind, Opcode &code)
+{
+    switch (kind)
+    {
+    case NodeKind::PLUS:
+        code = Opcode::ADD;
+        return true;
+    case NodeKind::MINUS:
+        code = Opcode::SUB;
+        return true;
+    case NodeKind::MULTIPLY:
+        code = Opcode::MUL;
+        return true;
+    case NodeKind::DIVIDE:
+        code = Opcode::DIV;
+        return true;
+    case NodeKind::EQ:
+        code = Opcode::EQ;
+        return true;
+    case NodeKind::NE:
+        code = Opcode::NE;
+        return true;
+    case NodeKind::GR:
+        code = Opcode::GR;
+        return true;
+    case NodeKind::GE:
+        code = Opcode::GE;
+        return true;
+    case NodeKind::LS:
+        code = Opcode::LS;
+        return true;
+    case NodeKind::LE:
+        code = Opcode::LE;
+        return true;
+    case NodeKind::OR:
+        code = Opcode::OR;
+        return true;
+    case NodeKind::AMPERSAND:
+        code = Opcode::AND;
+        return true;
+    case NodeKind::AUG:
+        code = Opcode::AUG;
+        return true;
+    case NodeKind::NEG:
+        code = Opcode::NEG;
+        return true;
+    case NodeKind::NOT:
+        code = Opcode::NOT;
+        return true;
+    default:
+        return false;
+    }
+}
+
+// what createCS and the bytecode compiler emit for each node kind
+enum class CSEmit : unsigned char
+{
+    INVALID,
+    LAMBDA,
+    TAU,
+    CONDITIONAL,
+    GAMMA,
+    IDENTIFIER,
+    STRING,
+    INTEGER,
+    OPERATOR
+};
+
+struct CSKind
+{
+    CSEmit emit;
+    Opcode opcode; // for operators
+};
+
+// entry of the kind table, built once
+inline const CSKind &csKind(NodeKind kind)
+{
+    static const array<CSKind, NODE_KIND_COUNT> table = []
+    {
+        array<CSKind, NODE_KIND_COUNT> entries{};
+        for (int i = 0; i < NODE_KIND_COUNT; i++)
+        {
+            Opcode code;
+            if (operatorOpcode(static_cast<NodeKind>(i), code))
+            {
+                entries[i] = {CSEmit::OPERATOR, code};
+            }
+        }
+
+        entries[static_cast<int>(NodeKind::LAMBDA)].emit = CSEmit::LAMBDA;
+        entries[static_cast<int>(NodeKind::TAU)].emit = CSEmit::TAU;
+        entries[static_cast<int>(NodeKind::CONDITIONAL)].emit = CSEmit::CONDITIONAL;
+        entries[static_cast<int>(NodeKind::GAMMA)].emit = CSEmit::GAMMA;
+        entries[static_cast<int>(NodeKind::IDENTIFIER)].emit = CSEmit::IDENTIFIER;
+        entries[static_cast<int>(NodeKind::STRING)].emit = CSEmit::STRING;
+        entries[static_cast<int>(NodeKind::INTEGER)].emit = CSEmit::INTEGER;
+        return entries;
+    }();
+
+    return table[static_cast<int>(kind)];
+}
+
+// value of an integer literal, as createCS and the bytecode compiler read it
+inline long long parseInteger(string_view digits)
+{
+    long long value = 0;
+    if (from_chars(digits.data(), digits.data() + digits.size(), value).ec != errc())
+    {
+        throw out_of_range("Integer out of range: " + string(digits));
+    }
+    return value;
+}
+
+struct Instr
+{
+    Opcode op;
+    int a = 0;
+    int b = 0;
+    int c = 0;
+};
+
+// a compiled control structure
+struct Block
+{
+    int start = 0;                 // pc of the first instruction
+    vector<string> boundVariables; // variables bound when the block is a lambda body
+    bool isSingleBoundVar = true;
+    shared_ptr<const string> boundName; // single bound variable, shared by every closure of the block
+};
+
+// flat instruction stream with its constant pools
+struct BytecodeProgram
+{
+    vector<Instr> code;
+    vector<uint32_t> offsets; // source offset of each instruction, beside the code so instructions do not grow
+    vector<Block> blocks; // block i matches control structure i of the CSE path
+    vector<long long> integers;
+    vector<shared_ptr<const string>> strings;
+    vector<shared_ptr<const string>> names;
+    int etaBlock = 0; // applies the two pending gammas of a Y* unfolding
+
+    // instructions of a program loaded from a cache file, run in place instead of code
+    const Instr *mappedCode = nullptr;
+    const uint32_t *mappedOffsets = nullptr;
+    shared_ptr<const void> storage; // keeps the mapped file alive
+
+    const Instr *instructions() const { return mappedCode != nullptr ? mappedCode : code.data(); }
+
+    const uint32_t *sourceOffsets() const { return mappedOffsets != nullptr ? mappedOffsets : offsets.data(); }
+};
+
+// Lowers the standardized tree to bytecode.
+// Blocks are numbered exactly like CSE::createCS numbers control structures, so closures print the same.
+class BytecodeCompiler
+{
+private:
+    BytecodeProgram program;
+    vector<vector<Instr>> blockCode;      // per block, in control structure (pre-order) layout
+    vector<vector<uint32_t>> blockOffsets; // source offsets of blockCode
+    const SymbolTable *symbols = nullptr; // names of the identifiers in the tree being compiled
+
+    int newBlock()
+    {
+        blockCode.emplace_back();
+        blockOffsets.emplace_back();
+        program.blocks.emplace_back();
+        return static_cast<int>(blockCode.size()) - 1;
+    }
+
+    int addString(vector<shared_ptr<const string>> &pool, string_view value)
+    {
+        pool.push_back(make_shared<const string>(value));
+        return static_cast<int>(pool.size()) - 1;
+    }
+
+    // append an instruction compiled from node to block
+    void emit(int block, Instr instr, TreeNode *node)
+    {
+        blockCode[block].push_back(instr);
+        blockOffsets[block].push_back(node->getOffset());
+    }
+
+    // emit the control structure of root into block, in the same order as CSE::createCS.
+    // The tree is walked in pre-order with an explicit stack, so nesting depth is bounded only
+    // by memory; tail is set when the value of a node is the value of its lambda body.
+    void compile(TreeNode *root, int block)
+    {
+        struct Pending
+        {
+            TreeNode *node;
+            int block;         // block the node is emitted into
+            bool tail = false; // the value of the node is the value of its lambda body
+        };
+
+        vector<Pending> pending = {{root, block}};
+
+        while (!pending.empty())
+        {
+            TreeNode *node = pending.back().node;
+            int target = pending.back().block;
+            bool tail = pending.back().tail;
+            pending.pop_back();
+
+            const CSKind &kind = csKind(node->getKind());
+            NodeSpan children = node->getChildren();
+
+            switch (kind.emit)
+            {
+            case CSEmit::LAMBDA:
+            {
+                int body = newBlock();
+                TreeNode *binder = children[0];
+
+                if (binder->getKind() == NodeKind::COMMA)
+                {
+                    for (TreeNode *child : binder->getChildren())
+                    {
+                        program.blocks[body].boundVariables.push_back(string(child->getValue()));
+                    }
+                    program.blocks[body].isSingleBoundVar = false;
+                }
+                else
+                {
+                    program.blocks[body].boundVariables.push_back(string(binder->getValue()));
+                    program.blocks[body].boundName = binder->getKind() == NodeKind::IDENTIFIER
+                                                         ? symbols->name(binder->getSymbol())
+                                                         : make_shared<const string>(binder->getValue());
+                }
+
+                emit(target, {Opcode::PUSH_LAMBDA, body}, node);
+                pending.push_back({children[1], body, true});
+                break;
+            }
+            case CSEmit::CONDITIONAL:
+            {
+                int thenBlock = newBlock();
+                int elseBlock = newBlock();
+
+                emit(target, {Opcode::BRANCH, thenBlock, elseBlock}, node);
+
+                // popped in order: then branch, else branch, condition
+                pending.push_back({children[0], target});
+                pending.push_back({children[2], elseBlock, tail});
+                pending.push_back({children[1], thenBlock, tail});
+                break;
+            }
+            case CSEmit::TAU:
+            case CSEmit::GAMMA:
+            case CSEmit::OPERATOR:
+            {
+                if (kind.emit == CSEmit::TAU)
+                {
+                    emit(target, {Opcode::TAU, static_cast<int>(children.size())}, node);
+                }
+                else if (kind.emit == CSEmit::GAMMA)
+                {
+                    emit(target, {Opcode::GAMMA, 0, tail ? 1 : 0}, node);
+                }
+                else
+                {
+                    emit(target, {kind.opcode}, node);
+                }
+
+                for (size_t i = children.size(); i-- > 0;)
+                {
+                    pending.push_back({children[i], target});
+                }
+                break;
+            }
+            case CSEmit::IDENTIFIER:
+            {
+                program.names.push_back(symbols->name(node->getSymbol()));
+                emit(target, {Opcode::LOAD, node->getDepth(), node->getSlot(), static_cast<int>(program.names.size()) - 1}, node);
+                break;
+            }
+            case CSEmit::STRING:
+            {
+                emit(target, {Opcode::PUSH_STR, addString(program.strings, node->getValue())}, node);
+                break;
+            }
+            case CSEmit::INTEGER:
+            {
+                program.integers.push_back(parseInteger(node->getValue()));
+                emit(target, {Opcode::PUSH_INT, static_cast<int>(program.integers.size()) - 1}, node);
+                break;
+            }
+            default:
+                throw runtime_error("Invalid node type: " + string(node->getLabel()) + "Value: " + string(node->getValue()));
+            }
+        }
+    }
+
+public:
+    BytecodeProgram compile(TreeNode *root, const SymbolTable &names)
+    {
+        symbols = &names;
+        program = BytecodeProgram();
+        blockCode.clear();
+        blockOffsets.clear();
+
+        compile(root, newBlock());
+
+        program.etaBlock = newBlock();
+        // the second gamma applies the unfolded function in the place of the gamma that unfolded it
+        blockCode[program.etaBlock] = {{Opcode::GAMMA}, {Opcode::GAMMA, 0, 1}};
+        blockOffsets[program.etaBlock] = {NO_OFFSET, NO_OFFSET};
+
+        // lay the blocks out in execution order, each followed by its terminator
+        vector<int> lambdaBodies(blockCode.size(), 0);
+        for (auto &instructions : blockCode)
+        {
+            for (auto &instr : instructions)
+            {
+                if (instr.op == Opcode::PUSH_LAMBDA)
+                {
+                    lambdaBodies[instr.a] = 1;
+                }
+            }
+        }
+
+        int blockCount = static_cast<int>(blockCode.size());
+        for (int i = 0; i < blockCount; i++)
+        {
+            program.blocks[i].start = static_cast<int>(program.code.size());
+
+            if (i != program.etaBlock)
+            {
+                reverse(blockCode[i].begin(), blockCode[i].end());
+                reverse(blockOffsets[i].begin(), blockOffsets[i].end());
+            }
+            program.code.insert(program.code.end(), blockCode[i].begin(), blockCode[i].end());
+            program.offsets.insert(program.offsets.end(), blockOffsets[i].begin(), blockOffsets[i].end());
+
+            Opcode terminator = i == 0 ? Opcode::HALT : (lambdaBodies[i] ? Opcode::EXIT_ENV : Opcode::END);
+            program.code.push_back({terminator});
+            program.offsets.push_back(NO_OFFSET);
+        }
+
+        // resolve branch targets to program counters
+        for (auto &instr : program.code)
+        {
+            if (instr.op == Opcode::BRANCH)
+            {
+                instr.a = program.blocks[instr.a].start;
+                instr.b = program.blocks[instr.b].start;
+            }
+        }
+
+        blockCode.clear();
+        blockOffsets.clear();
+        return move(program);
+    }
+};
+
+#endif // BYTECODE_H
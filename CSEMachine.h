@@ -4,11 +4,21 @@
 #include <iostream>
 #include <vector>
 #include <string>
+#include <string_view>
 #include <unordered_map>
+#include <unordered_set>
 #include <utility>
+#include <memory>
+#include <algorithm>
+#include <array>
+#include <climits>
 #include <stdexcept>
 #include "Tree.h"
 #include "BOP/binaryOP.h"
+#include "Bytecode.h"
+#include "Resolver.h"
+#include "OutputSink.h"
+#include "Profiler.h"
 
 using namespace std;
 
@@ -30,95 +40,163 @@ enum class ObjectType : int
     BOOLEAN
 };
 
-vector<string> built_in_functions = {"Print", "print", "Order", "Y*", "Conc", "Stem", "Stern", "Isinteger", "Isstring", "Istuple", "Isempty", "dummy", "ItoS"};
-
-bool isOperator(const string &label);
-
 class CSENode
 {
 private:
     // General node properties
-    ObjectType nodeType;
-    string nodeValue;
+    ObjectType nodeType = ObjectType::ENV;
+
+    // Native payload, selected by nodeType:
+    // integer or boolean value, tau arity, delta/lambda/eeta control structure index, tuple order,
+    // string length
+    long long value{};
+    int env{};                          // lambda and eeta nodes; offset of a string in its buffer
+    bool growable = false;              // string buffer built at run time, may be appended in place
+    shared_ptr<const string> text;      // string buffer, identifier/operator name, single bound variable
+    shared_ptr<vector<CSENode>> elements; // tuple elements; a tuple is the first `value` of them
+
+    // Drop the last handle to a tuple buffer. Nested buffers it holds the last handle to are
+    // taken out and dropped one at a time, so a deeply nested tuple is torn down in a loop
+    // instead of one destructor call per level.
+    static void releaseElements(shared_ptr<vector<CSENode>> buffer)
+    {
+        vector<shared_ptr<vector<CSENode>>> pending;
+        while (true)
+        {
+            for (CSENode &element : *buffer)
+            {
+                if (element.elements != nullptr && element.elements.use_count() == 1)
+                {
+                    pending.push_back(move(element.elements));
+                }
+            }
+            buffer.reset();
 
-    // lambda and eeta nodes
-    int env{};
-    int csIndex{}; // for delta, tau, eeta, lambda nodes
-    vector<string> boundVariables;
-    vector<CSENode> listElements;
-    bool isSingleBoundVar = true;
+            if (pending.empty())
+            {
+                return;
+            }
+            buffer = move(pending.back());
+            pending.pop_back();
+        }
+    }
 
 public:
     CSENode() = default;
 
-    // constructors
-    // lambda (in stack) and eeta nodes
-    CSENode(ObjectType nodeType, string nodeValue, int csIndex, int env)
+    CSENode(const CSENode &) = default;
+    CSENode(CSENode &&) noexcept = default;
+    CSENode &operator=(const CSENode &) = default;
+    CSENode &operator=(CSENode &&) noexcept = default;
+
+    ~CSENode()
     {
-        this->nodeType = nodeType;
-        this->nodeValue = move(nodeValue);
-        this->csIndex = csIndex;
-        this->env = env;
+        if (elements != nullptr && elements.use_count() == 1)
+        {
+            releaseElements(move(elements));
+        }
     }
 
-    // lambda (in control structure) nodes
-    CSENode(ObjectType nodeType, string nodeValue, int csIndex)
+    // constructors
+    // lambda (in stack) and eeta nodes
+    CSENode(ObjectType nodeType, shared_ptr<const string> var, int csIndex, int env)
+        : nodeType(nodeType), value(csIndex), env(env), text(move(var)) {}
+
+    // identifiers with their lexical address
+    CSENode(ObjectType nodeType, int depth, int slot, shared_ptr<const string> name)
+        : nodeType(nodeType), value(slot), env(depth), text(move(name)) {}
+
+    // integers, booleans and control nodes carrying an index or count
+    CSENode(ObjectType nodeType, long long value) : nodeType(nodeType), value(value) {}
+
+    // strings, identifiers and operators sharing an immutable buffer
+    CSENode(ObjectType nodeType, shared_ptr<const string> text)
+        : nodeType(nodeType), value(text ? static_cast<long long>(text->size()) : 0), text(move(text)) {}
+
+    CSENode(ObjectType nodeType, const string &text)
+        : nodeType(nodeType), value(static_cast<long long>(text.size())), text(make_shared<const string>(text)) {}
+
+    // string slice [start, start + length) of a shared buffer
+    static CSENode slice(shared_ptr<const string> buffer, int start, long long length, bool growable)
     {
-        this->nodeType = nodeType;
-        this->nodeValue = move(nodeValue);
-        this->csIndex = csIndex;
+        CSENode node(ObjectType::STRING, move(buffer));
+        node.env = start;
+        node.value = length;
+        node.growable = growable;
+        return node;
     }
 
-    // lambda (in control structure) nodes with bound variables
-    CSENode(ObjectType nodeType, int csIndex, vector<string> boundVariables)
+    // tuples: a prefix of an element buffer that may be shared with longer tuples
+    CSENode(ObjectType nodeType, shared_ptr<vector<CSENode>> buffer, long long order)
+        : nodeType(nodeType), value(order), elements(move(buffer)) {}
+
+    CSENode(ObjectType nodeType, vector<CSENode> listElements)
+        : nodeType(nodeType), value(static_cast<long long>(listElements.size())),
+          elements(make_shared<vector<CSENode>>(move(listElements))) {}
+
+    // getters
+    ObjectType get_NodeType() const { return nodeType; }
+
+    long long get_IntValue() const { return value; }
+
+    bool get_BoolValue() const { return value != 0; }
+
+    const string &get_String() const
     {
-        isSingleBoundVar = false;
-        this->nodeType = nodeType;
-        this->csIndex = csIndex;
-        this->boundVariables = move(boundVariables);
+        static const string empty;
+        return text ? *text : empty;
     }
 
-    // lambda (in stack) nodes with bound variables
-    CSENode(ObjectType nodeType, int csIndex, vector<string> boundVariables, int env)
+    const shared_ptr<const string> &get_StringHandle() const { return text; }
+
+    // contents of a string node without copying its buffer
+    string_view get_StringView() const
     {
-        isSingleBoundVar = false;
-        this->nodeType = nodeType;
-        this->nodeValue = move(nodeValue);
-        this->csIndex = csIndex;
-        this->env = env;
-        this->boundVariables = move(boundVariables);
+        return text ? string_view(*text).substr(env, value) : string_view();
     }
 
-    // other nodes
-    CSENode(ObjectType nodeType, string nodeValue)
+    // the string ends its buffer, which was built at run time, so it may be extended in place
+    bool get_IsBufferTail() const
     {
-        this->nodeType = nodeType;
-        this->nodeValue = move(nodeValue);
+        return growable && env + value == static_cast<long long>(text->size());
     }
 
-    // lists elem_1
-    CSENode(ObjectType nodeType, vector<CSENode> listElements)
+    // textual form of the node, used for printing and error messages
+    string get_nodeValue() const
     {
-        this->nodeType = nodeType;
-        this->listElements = move(listElements);
+        switch (nodeType)
+        {
+        case ObjectType::INTEGER:
+        case ObjectType::TAU:
+        case ObjectType::DELTA:
+        case ObjectType::ENV:
+            return to_string(value);
+        case ObjectType::BOOLEAN:
+            return value ? "true" : "false";
+        case ObjectType::STRING:
+            return string(get_StringView());
+        default:
+            return get_String();
+        }
     }
 
-    // getters
-    ObjectType get_NodeType() const { return nodeType; }
+    int get_ENV() const { return env; }
 
-    string get_nodeValue() const { return nodeValue; }
+    int get_CSIndex() const { return static_cast<int>(value); }
 
-    int get_ENV() const { return env; }
+    // lexical address of an identifier; depth is -1 for free identifiers
+    int get_Depth() const { return env; }
 
-    int get_CSIndex() const { return csIndex; }
+    int get_Slot() const { return static_cast<int>(value); }
 
-    bool get_IsSingleBoundVar() const { return isSingleBoundVar; }
+    // number of elements of a tuple
+    long long get_Order() const { return value; }
 
-    vector<string> get_varList() const { return boundVariables; }
+    // element i (0-based) of a tuple; elements are shared, never copied on read
+    const CSENode &get_Element(long long i) const { return (*elements)[i]; }
 
-    vector<CSENode> get_ListElements() const { return listElements; }
+    const shared_ptr<vector<CSENode>> &get_TupleBuffer() const { return elements; }
 
-    // setter
     CSENode set_ENV(int newEnv)
     {
         this->env = newEnv;
@@ -132,36 +210,59 @@ class ControlStructure
 private:
     int csIndex;
     vector<CSENode> nodes;
+    vector<uint32_t> offsets; // source offset of each node, kept beside the nodes so they do not grow
+
+    // variables bound by the lambda owning this structure
+    vector<string> boundVariables;
+    bool isSingleBoundVar = true;
+
+    // function this structure is the body of, for profiles; null for branches
+    shared_ptr<const string> functionName;
 
 public:
     // Constructor with empty nodes
     explicit ControlStructure(int csIndex) { this->csIndex = csIndex; }
 
-    // add node to control structure
-    void addNode(CSENode node) { nodes.push_back(node); }
+    // add node to control structure, with the source offset of the tree node it came from
+    void addNode(CSENode node, uint32_t offset = NO_OFFSET)
+    {
+        nodes.push_back(move(node));
+        offsets.push_back(offset);
+    }
 
     // Getters
     int get_CSIndex() const { return csIndex; }
 
-    // pop the last node in the control structure
-    void popLastNode() { nodes.pop_back(); }
+    bool get_IsSingleBoundVar() const { return isSingleBoundVar; }
 
-    // pop and return the last node in the control structure
-    CSENode returnLastNode()
-    {
-        CSENode node = nodes.back();
-        nodes.pop_back();
-        return node;
-    }
+    const vector<string> &get_varList() const { return boundVariables; }
 
-    // push another control structure to the current control structure
-    void addNewCS(const ControlStructure &cs)
+    // set the variables bound on entry (tuple binding when more than one)
+    void set_BoundVariables(vector<string> vars, bool single)
     {
-        for (auto &node : cs.nodes)
-        {
-            nodes.push_back(node);
-        }
+        boundVariables = move(vars);
+        isSingleBoundVar = single;
     }
+
+    const shared_ptr<const string> &get_FunctionName() const { return functionName; }
+
+    void set_FunctionName(shared_ptr<const string> name) { functionName = move(name); }
+
+    // number of nodes in the control structure
+    int size() const { return static_cast<int>(nodes.size()); }
+
+    // node at a position; control runs a structure from its last node to its first
+    const CSENode &get_Node(int pos) const { return nodes[pos]; }
+
+    uint32_t get_Offset(int pos) const { return offsets[pos]; }
+};
+
+// Control of the CSE machine is a stack of frames pointing into immutable control structures,
+// so entering a lambda body or a branch costs one push instead of a copy of its nodes.
+struct ControlFrame
+{
+    int csIndex; // structure being run, or -1 for an environment marker
+    int pc;      // nodes of the structure still to run, or the env id of the marker
 };
 
 class Stack
@@ -174,7 +275,7 @@ public:
     Stack() = default;
 
     // add node
-    void addNode(const CSENode &node) { nodes.push_back(node); }
+    void addNode(CSENode node) { nodes.push_back(move(node)); }
 
     // pop the last node
     void popLastNode() { nodes.pop_back(); }
@@ -182,958 +283,1553 @@ public:
     // pop and return the last node
     CSENode returnLastNode()
     {
-        CSENode node = nodes.back();
+        CSENode node = move(nodes.back());
         nodes.pop_back();
         return node;
     }
 
     // length of the stack
     int length() const { return static_cast<int>(nodes.size()); }
+
+    // every node on the stack, bottom first
+    const vector<CSENode> &get_Nodes() const { return nodes; }
 };
 
 class Env
 {
 private:
-    unordered_map<string, CSENode> variables;
-    unordered_map<string, CSENode> lambdas;
-    unordered_map<string, vector<CSENode>> lists;
+    vector<CSENode> slots; // variables bound by one lambda, indexed by their lexical slot
     Env *parentENV;
 
 public:
+    bool marked = false; // reached by the last collection
+
     // constructor empty env
     Env() { parentENV = nullptr; }
 
-    explicit Env(Env *parentENV) { this->parentENV = parentENV; }
+    Env(Env *parentENV, int size) : slots(size), parentENV(parentENV) {}
+
+    Env *get_Parent() const { return parentENV; }
+
+    const vector<CSENode> &get_Slots() const { return slots; }
+
+    // bind the variable at slot
+    void bind(int slot, const CSENode &value)
+    {
+        if (slot < 0 || static_cast<size_t>(slot) >= slots.size())
+        {
+            throw runtime_error("Too many values for the bound variables");
+        }
+        slots[slot] = value;
+    }
+
+    // find the value at a lexical address; nullptr when the slot was never bound
+    const CSENode *lookup(int depth, int slot) const
+    {
+        const Env *env = this;
+        for (int i = 0; i < depth; i++)
+        {
+            env = env->parentENV;
+        }
+
+        const CSENode &value = env->slots[slot];
+        return value.get_NodeType() == ObjectType::ENV ? nullptr : &value;
+    }
+};
+
+class CSE
+{
+private:
+    vector<ControlStructure *> controlStructures;
+    vector<ControlFrame> control;
+    Stack stack = Stack();
+    OutputSink defaultOutput;
+    OutputSink *out = &defaultOutput; // destination of Print
+    shared_ptr<const string> dummyName = make_shared<const string>("dummy");
+    vector<int> env_stack = vector<int>();
+    vector<Env *> envs = vector<Env *>(); // indexed by env id; nullptr once reclaimed
+
+    // environment reclamation: ids of collected envs are reused
+    vector<int> free_envs;
+    int live_envs = 0;
+    int peak_envs = 0;
+    long long created_envs = 0;
+    int collect_threshold = 1024; // live envs that trigger the next collection
 
-    // add single variable to env
-    void add_variable(const string &identifier, const CSENode &value) { variables[identifier] = value; }
+    // run statistics; depths are sampled only when asked for, at one branch per step
+    bool trackDepth = false;
+    long long gammas = 0;
+    int peakStack = 0;
+    int peakControl = 0;
+
+    Profiler *profiler = nullptr;
+    const SourceMap *sourceMap = nullptr; // lines of the program, for locating errors
+
+    void recordDepth(size_t controlDepth)
+    {
+        peakStack = max(peakStack, stack.length());
+        peakControl = max(peakControl, static_cast<int>(controlDepth));
+    }
 
-    // add multiple variable to env
-    void add_variables(const vector<string> &identifiers, const vector<CSENode> &values)
+    // create an environment below parent (-1 for e0) and return its id
+    int allocateEnv(int parent, int size)
     {
-        for (int i = 0; i < identifiers.size(); i++)
+        if (live_envs >= collect_threshold)
         {
-            variables[identifiers[i]] = values[i];
+            // the next collection waits for as many new environments as this one visited
+            // values, so a large reachable tuple is not re-marked every 1024 allocations
+            long long work = collectEnvs(parent);
+            long long gap = max<long long>({1024, live_envs, work});
+            collect_threshold = static_cast<int>(min<long long>(INT_MAX, live_envs + gap));
         }
+
+        Env *env = parent < 0 ? new Env() : new Env(envs[parent], size);
+        int id;
+        if (free_envs.empty())
+        {
+            id = static_cast<int>(envs.size());
+            envs.push_back(env);
+        }
+        else
+        {
+            id = free_envs.back();
+            free_envs.pop_back();
+            envs[id] = env;
+        }
+
+        created_envs++;
+        peak_envs = max(peak_envs, ++live_envs);
+        return id;
     }
 
-    void add_List(const string &identifier, vector<CSENode> listElements) { lists[identifier] = move(listElements); }
+    // what a collection has left to visit; a tuple buffer is queued only the first time it is reached
+    struct MarkQueue
+    {
+        vector<Env *> envs;
+        vector<const vector<CSENode> *> tuples;
+        unordered_set<const vector<CSENode> *> seenTuples;
+    };
+
+    // queue what a value keeps alive; closures capture their environment, tuples may hold closures
+    void markValue(const CSENode &value, MarkQueue &queue)
+    {
+        if (value.get_NodeType() == ObjectType::LAMBDA || value.get_NodeType() == ObjectType::EETA)
+        {
+            queue.envs.push_back(envs[value.get_ENV()]);
+        }
+        else if (value.get_NodeType() == ObjectType::LIST && value.get_TupleBuffer() != nullptr &&
+                 queue.seenTuples.insert(value.get_TupleBuffer().get()).second)
+        {
+            queue.tuples.push_back(value.get_TupleBuffer().get());
+        }
+    }
 
-    // add lambda to environment
-    void add_Lambda(const string &identifier, const CSENode &lambda)
+    // mark-sweep over the environments reachable from the machine state;
+    // extra is an env id held outside the stack (the closure being applied), or -1.
+    // Returns the work done: environments marked and tuple elements visited.
+    long long collectEnvs(int extra)
     {
+        MarkQueue queue;
+        long long work = 0;
+
+        for (int id : env_stack)
+        {
+            queue.envs.push_back(envs[id]);
+        }
+        if (extra >= 0)
+        {
+            queue.envs.push_back(envs[extra]);
+        }
+        for (const auto &value : stack.get_Nodes())
+        {
+            markValue(value, queue);
+        }
 
-        // check the node type and create new object
-        if (lambda.get_NodeType() == ObjectType::LAMBDA)
+        while (!queue.envs.empty() || !queue.tuples.empty())
         {
-            if (lambda.get_IsSingleBoundVar())
+            if (!queue.tuples.empty())
+            {
+                const vector<CSENode> *elements = queue.tuples.back();
+                queue.tuples.pop_back();
+
+                // the whole buffer is kept alive, not only the part a tuple sees
+                for (const auto &value : *elements)
+                {
+                    markValue(value, queue);
+                }
+                work += static_cast<long long>(elements->size());
+                continue;
+            }
+
+            Env *env = queue.envs.back();
+            queue.envs.pop_back();
+
+            if (env == nullptr || env->marked)
             {
-                lambdas[identifier] = CSENode(ObjectType::LAMBDA, lambda.get_nodeValue(), lambda.get_CSIndex(), lambda.get_ENV());
+                continue;
             }
-            else
+            env->marked = true;
+            work++;
+            queue.envs.push_back(env->get_Parent());
+
+            for (const auto &value : env->get_Slots())
             {
-                lambdas[identifier] = CSENode(ObjectType::LAMBDA, lambda.get_CSIndex(), lambda.get_varList(), lambda.get_ENV());
+                markValue(value, queue);
             }
         }
-        else if (lambda.get_NodeType() == ObjectType::EETA)
+
+        int envCount = static_cast<int>(envs.size());
+        for (int id = 0; id < envCount; id++)
         {
-            if (lambda.get_IsSingleBoundVar())
+            if (envs[id] == nullptr)
             {
-                lambdas[identifier] = CSENode(ObjectType::EETA, lambda.get_nodeValue(), lambda.get_CSIndex(), lambda.get_ENV());
+                continue;
+            }
+            if (envs[id]->marked)
+            {
+                envs[id]->marked = false;
             }
             else
             {
-                lambdas[identifier] = CSENode(ObjectType::EETA, lambda.get_CSIndex(), lambda.get_varList(), lambda.get_ENV());
+                delete envs[id];
+                envs[id] = nullptr;
+                free_envs.push_back(id);
+                live_envs--;
             }
         }
-        else
+        return work;
+    }
+
+    // truth value of a node used by beta, not, or and &
+    static bool isTruthy(const CSENode &node)
+    {
+        if (node.get_NodeType() == ObjectType::BOOLEAN || node.get_NodeType() == ObjectType::INTEGER)
+        {
+            return node.get_BoolValue();
+        }
+        throw invalid_argument("Invalid operator or operand: " + node.get_nodeValue());
+    }
+
+    // start running a control structure from its last node
+    void pushCS(int csIndex)
+    {
+        control.push_back({csIndex, controlStructures[csIndex]->size()});
+    }
+
+    // Return from the calls that have nothing left to run, before a call in tail position takes
+    // their place: the value of that call is theirs. Control, stack and environments then stay
+    // the same size however many tail calls a loop makes. What is left to run is checked here
+    // rather than assumed, since the last gamma of a Y* unfolding is marked wherever it unfolds.
+    void leaveFinishedCalls()
+    {
+        while (true)
         {
-            throw runtime_error("Invalid lambda node type");
+            const ControlFrame &frame = control.back();
+            if (frame.csIndex >= 0 && frame.pc == 0)
+            {
+                control.pop_back();
+            }
+            else if (frame.csIndex < 0 && frame.pc != 0)
+            {
+                // the marker of a call; e0 is never left
+                control.pop_back();
+                exitEnv();
+            }
+            else
+            {
+                break;
+            }
         }
     }
 
-    // find variable from environment
-    CSENode findVariable(const string &identifier)
+    // drop the next control item without running it
+    void skipControl()
     {
-        if (variables.find(identifier) != variables.end())
+        while (control.back().csIndex >= 0 && control.back().pc == 0)
         {
-            return variables[identifier];
+            control.pop_back();
         }
-        else if (parentENV != nullptr)
+        if (control.back().csIndex >= 0)
         {
-            return parentENV->findVariable(identifier);
+            control.back().pc--;
         }
-        else
+        else if (control.back().pc != 0)
+        {
+            control.pop_back();
+        }
+    }
+
+    // Give the profiler the current call stack. Each environment marker on the control opens a
+    // call, named after the lambda body run right above it; a call whose body has already
+    // finished is left out.
+    void sampleStack()
+    {
+        string collapsed = *controlStructures[0]->get_FunctionName();
+        bool open = false;
+        for (size_t i = 1; i < control.size(); i++)
         {
-            throw runtime_error("Identifier: " + identifier + " not found");
+            if (control[i].csIndex < 0)
+            {
+                open = true;
+            }
+            else if (open && controlStructures[control[i].csIndex]->get_FunctionName() != nullptr)
+            {
+                collapsed += ';';
+                collapsed += *controlStructures[control[i].csIndex]->get_FunctionName();
+                open = false;
+            }
         }
+        profiler->record(collapsed);
     }
 
-    // find lambda from environment
-    CSENode findLambda(const string &identifier)
+    // Rethrow the error being handled with the line and column of the node that raised it.
+    // Errors of nodes with no place in the source, and failures of the machine itself, pass unchanged.
+    [[noreturn]] void rethrowAt(uint32_t offset)
     {
-        if (lambdas.find(identifier) != lambdas.end())
+        if (sourceMap == nullptr || offset == NO_OFFSET)
         {
-            return lambdas[identifier];
+            throw;
         }
-        else if (parentENV != nullptr)
+        try
         {
-            return parentENV->findLambda(identifier);
+            throw;
         }
-        else
+        catch (const runtime_error &error)
         {
-            throw runtime_error("Identifier: " + identifier + " not found");
+            throw runtime_error(string(error.what()) + " at " + sourceMap->describe(offset));
+        }
+        catch (const logic_error &error)
+        {
+            throw runtime_error(string(error.what()) + " at " + sourceMap->describe(offset));
         }
     }
 
-    // find list from environment
-    vector<CSENode> findList(const string &identifier)
+    // store a control structure at its index; indices of nested branches are allocated out of order
+    void addControlStructure(ControlStructure *cs)
     {
-        if (lists.find(identifier) != lists.end())
+        if (static_cast<size_t>(cs->get_CSIndex()) >= controlStructures.size())
         {
-            return lists[identifier];
+            controlStructures.resize(cs->get_CSIndex() + 1, nullptr);
         }
-        else if (parentENV != nullptr)
-        {
-            return parentENV->findList(identifier);
-        } // call get list recursively
-        else
+        controlStructures[cs->get_CSIndex()] = cs;
+    }
+
+    // shared name of a single bound variable; () binds no name
+    static shared_ptr<const string> boundName(TreeNode *binder, const SymbolTable &symbols)
+    {
+        if (binder->getKind() != NodeKind::IDENTIFIER)
         {
-            throw runtime_error("Identifier: " + identifier + " not found");
+            return make_shared<const string>(binder->getValue());
         }
+        return symbols.name(binder->getSymbol());
     }
-};
-
-class CSE
-{
-private:
-    int next_env = 0;
-    int nextCS = -1;
-
-    vector<ControlStructure *> controlStructures;
-    ControlStructure cse_machine = ControlStructure(-1);
-    Stack stack = Stack();
-    vector<int> env_stack = vector<int>();
-    unordered_map<int, Env *> envs = unordered_map<int, Env *>();
 
 public:
     // constructor with empty control structures and stack
     CSE() = default;
 
-    // create control structures
-    void createCS(TreeNode *root, ControlStructure *current_cs = nullptr, int currentCSIndex = -1)
-    {
-        ControlStructure *cs;
+    CSE(const CSE &) = delete;
+    CSE &operator=(const CSE &) = delete;
 
-        if (nextCS == -1)
+    ~CSE()
+    {
+        for (auto *env : envs)
         {
-            nextCS++;
-            cs = new ControlStructure(nextCS++);
-            controlStructures.push_back(cs);
-            currentCSIndex = 0;
+            delete env;
         }
-        else
+        for (auto *cs : controlStructures)
         {
-            cs = current_cs;
+            delete cs;
         }
+    }
 
-        if (root->getLabel() == "lambda")
-        {
-            CSENode *lambda;
-            if (root->getChildren()[0]->getLabel() == ",")
-            {
-                vector<string> vars;
-                for (auto &child : root->getChildren()[0]->getChildren())
-                {
-                    vars.push_back(child->getValue());
-                }
+    // write what Print produces to sink instead of cout; the caller flushes it
+    void setOutput(OutputSink &sink)
+    {
+        out = &sink;
+    }
 
-                lambda = new CSENode(ObjectType::LAMBDA, nextCS, vars);
-            }
-            else
-            {
-                string var = root->getChildren()[0]->getValue();
-                lambda = new CSENode(ObjectType::LAMBDA, var, nextCS);
-            }
+    // environment counts, for sizing memory limits
+    long long getCreatedEnvs() const { return created_envs; }
 
-            cs->addNode(*lambda);
+    int getPeakEnvs() const { return peak_envs; }
 
-            auto *newCS = new ControlStructure(nextCS);
-            controlStructures.push_back(newCS);
-            createCS(root->getChildren()[1], newCS, nextCS++);
-        }
+    int getLiveEnvs() const { return live_envs; }
 
-        else if (root->getLabel() == "tau")
-        {
-            auto *tau = new CSENode(ObjectType::TAU, to_string(root->getChildren().size()));
-            cs->addNode(*tau);
+    // sample the peak stack and control depths while running
+    void setTrackDepth(bool enabled) { trackDepth = enabled; }
 
-            for (auto &child : root->getChildren())
-            {
-                createCS(child, cs, currentCSIndex);
-            }
-        }
+    long long getGammas() const { return gammas; }
 
-        else if (root->getLabel() == "->")
-        {
-            int thenCSIndex = nextCS++;
-            int elseCSIndex = nextCS++;
+    int getPeakStack() const { return peakStack; }
 
-            // Create new CSs
-            cs->addNode(*(new CSENode(ObjectType::DELTA, to_string(thenCSIndex))));
-            cs->addNode(*(new CSENode(ObjectType::DELTA, to_string(elseCSIndex))));
-            cs->addNode(*(new CSENode(ObjectType::BETA, "")));
+    int getPeakControl() const { return peakControl; }
 
-            auto *thenCS = new ControlStructure(thenCSIndex);
-            controlStructures.push_back(thenCS);
-            createCS(root->getChildren()[1], thenCS, thenCSIndex);
+    int getControlStructureCount() const { return static_cast<int>(controlStructures.size()); }
 
-            auto *elseCS = new ControlStructure(elseCSIndex);
-            controlStructures.push_back(elseCS);
-            createCS(root->getChildren()[2], elseCS, elseCSIndex);
+    // sample the call stack into profile while evaluating; the bytecode machine is not sampled
+    void setProfiler(Profiler *profile) { profiler = profile; }
 
-            createCS(root->getChildren()[0], cs, currentCSIndex);
-        }
-        else if (isOperator(root->getLabel()))
-        {
-            cs->addNode(*(new CSENode(ObjectType::OPERATOR, root->getLabel())));
+    // lines of the program, so run-time errors name the line and column that raised them and
+    // profiles the line of each function; set it before createCS
+    void setSourceMap(const SourceMap *map) { sourceMap = map; }
 
-            for (auto &child : root->getChildren())
+    // create control structures.
+    // The tree is walked in pre-order with an explicit stack, so nesting depth is bounded only
+    // by memory; structures are numbered in the order their lambdas and branches are reached.
+    // A gamma in tail position, the last thing its lambda body does, is marked with value 1.
+    void createCS(TreeNode *root, const SymbolTable &symbols)
+    {
+        struct Pending
+        {
+            TreeNode *node;
+            int csIndex;       // structure the node is emitted into
+            bool tail = false; // the value of the node is the value of its lambda body
+        };
+
+        int nextCS = 0;
+        addControlStructure(new ControlStructure(nextCS++));
+        controlStructures[0]->set_FunctionName(make_shared<const string>("<program>"));
+        auto anonymous = make_shared<const string>("lambda");
+
+        // name of a lambda body in profiles: its definition, followed by its line when the source is mapped
+        auto functionName = [&](TreeNode *lambda)
+        {
+            shared_ptr<const string> name = lambda->getSymbol() >= 0 ? symbols.name(lambda->getSymbol()) : anonymous;
+            if (sourceMap == nullptr || lambda->getOffset() == NO_OFFSET)
             {
-                createCS(child, cs, currentCSIndex);
+                return name;
             }
-        }
-        else if (root->getLabel() == "gamma")
+            return make_shared<const string>(*name + ":" + to_string(sourceMap->line(lambda->getOffset())));
+        };
+
+        vector<Pending> pending = {{root, 0}};
+
+        while (!pending.empty())
         {
-            cs->addNode(*(new CSENode(ObjectType::GAMMA, "")));
+            TreeNode *node = pending.back().node;
+            ControlStructure *cs = controlStructures[pending.back().csIndex];
+            int csIndex = pending.back().csIndex;
+            bool tail = pending.back().tail;
+            pending.pop_back();
 
-            for (auto &child : root->getChildren())
+            const CSKind &kind = csKind(node->getKind());
+            NodeSpan children = node->getChildren();
+
+            switch (kind.emit)
             {
-                createCS(child, cs, currentCSIndex);
-            }
-        }
-        else if (root->getLabel() == "identifier" || root->getLabel() == "integer" || root->getLabel() == "string")
-        {
-            string value = root->getValue();
-            string type = root->getLabel();
+            case CSEmit::LAMBDA:
+            {
+                int bodyIndex = nextCS++;
+                auto *body = new ControlStructure(bodyIndex);
+                TreeNode *binder = children[0];
+                body->set_FunctionName(functionName(node));
 
-            unordered_map<string, ObjectType> typeMap = {{"identifier", ObjectType::IDENTIFIER}, {"integer", ObjectType::INTEGER}, {"string", ObjectType::STRING}};
+                if (binder->getKind() == NodeKind::COMMA)
+                {
+                    vector<string> vars;
+                    vars.reserve(binder->getNumChildren());
+                    for (TreeNode *child : binder->getChildren())
+                    {
+                        vars.emplace_back(child->getValue());
+                    }
 
-            // Check if the type is valid and get the corresponding ObjectType
-            auto objectTypeIter = typeMap.find(type);
+                    body->set_BoundVariables(move(vars), false);
+                    cs->addNode(CSENode(ObjectType::LAMBDA, nullptr, bodyIndex, 0), node->getOffset());
+                }
+                else
+                {
+                    body->set_BoundVariables({string(binder->getValue())}, true);
+                    cs->addNode(CSENode(ObjectType::LAMBDA, boundName(binder, symbols), bodyIndex, 0), node->getOffset());
+                }
 
-            if (objectTypeIter != typeMap.end())
-            {
-                // Create the CSENode with the correct ObjectType
-                cs->addNode(CSENode(objectTypeIter->second, value));
+                addControlStructure(body);
+                pending.push_back({children[1], bodyIndex, true});
+                break;
             }
-            else
+            case CSEmit::CONDITIONAL:
             {
-                throw runtime_error("Invalid leaf type: " + type);
-            }
-        }
-        else
-        {
-            throw runtime_error("Invalid node type: " + root->getLabel() + "Value: " + root->getValue());
-        }
-    }
+                int thenCSIndex = nextCS++;
+                int elseCSIndex = nextCS++;
 
-    void evaluate()
-    {
-        auto *e0 = new CSENode(ObjectType::ENV, "0");
-        cse_machine.addNode(*e0);
-        stack.addNode(*e0);
-        env_stack.push_back(next_env++);
-        envs[0] = new Env(nullptr);
+                cs->addNode(CSENode(ObjectType::DELTA, thenCSIndex), node->getOffset());
+                cs->addNode(CSENode(ObjectType::DELTA, elseCSIndex), node->getOffset());
+                cs->addNode(CSENode(ObjectType::BETA, 0), node->getOffset());
 
-        cse_machine.addNewCS(*controlStructures[0]);
+                addControlStructure(new ControlStructure(thenCSIndex));
+                addControlStructure(new ControlStructure(elseCSIndex));
 
-        CSENode top = cse_machine.returnLastNode();
-
-        while ((top.get_NodeType() != ObjectType::ENV) || (top.get_nodeValue() != "0"))
-        {
-            if (top.get_NodeType() == ObjectType::INTEGER || top.get_NodeType() == ObjectType::STRING)
-            {
-                stack.addNode(top);
-                top = cse_machine.returnLastNode();
+                // popped in order: then branch, else branch, condition
+                pending.push_back({children[0], csIndex});
+                pending.push_back({children[2], elseCSIndex, tail});
+                pending.push_back({children[1], thenCSIndex, tail});
+                break;
             }
-            else if (top.get_NodeType() == ObjectType::IDENTIFIER)
+            case CSEmit::TAU:
+            case CSEmit::GAMMA:
+            case CSEmit::OPERATOR:
             {
-                CSENode value;
-                CSENode value_l;
-                vector<CSENode> list;
-
-                try
+                if (kind.emit == CSEmit::TAU)
                 {
-                    value = envs[env_stack.back()]->findVariable(top.get_nodeValue());
-                    stack.addNode(CSENode(value.get_NodeType(), value.get_nodeValue()));
+                    cs->addNode(CSENode(ObjectType::TAU, static_cast<long long>(children.size())), node->getOffset());
                 }
-                catch (runtime_error &e)
+                else if (kind.emit == CSEmit::GAMMA)
                 {
-                    try
-                    {
-                        value_l = envs[env_stack.back()]->findLambda(top.get_nodeValue());
-                        stack.addNode(value_l);
-                    }
-                    catch (runtime_error &e)
-                    {
-                        try
-                        {
-                            list = envs[env_stack.back()]->findList(top.get_nodeValue());
-                            stack.addNode(CSENode(ObjectType::LIST, list));
-                        }
-                        catch (runtime_error &e)
-                        {
-                            // if node value is in built_in_functions add the node to the stack
-                            if (find(built_in_functions.begin(), built_in_functions.end(),
-                                     top.get_nodeValue()) !=
-                                built_in_functions.end())
-                            {
-                                stack.addNode(top);
-                            }
-                            else if (top.get_nodeValue() == "nil")
-                            {
-                                stack.addNode(CSENode(ObjectType::LIST, vector<CSENode>()));
-                            }
-                            else
-                            {
-                                throw runtime_error("Variable not found: " + top.get_nodeValue());
-                            }
-                        }
-                    }
+                    cs->addNode(CSENode(ObjectType::GAMMA, tail ? 1 : 0), node->getOffset());
+                }
+                else
+                {
+                    // operators carry their opcode
+                    cs->addNode(CSENode(ObjectType::OPERATOR, static_cast<long long>(kind.opcode)), node->getOffset());
                 }
 
-                top = cse_machine.returnLastNode();
+                for (size_t i = children.size(); i-- > 0;)
+                {
+                    pending.push_back({children[i], csIndex});
+                }
+                break;
             }
-            else if (top.get_NodeType() == ObjectType::LAMBDA)
+            case CSEmit::IDENTIFIER:
             {
-                int current_env = env_stack.back();
-                stack.addNode(top.set_ENV(current_env));
-
-                top = cse_machine.returnLastNode();
+                cs->addNode(CSENode(ObjectType::IDENTIFIER, node->getDepth(), node->getSlot(), symbols.name(node->getSymbol())), node->getOffset());
+                break;
+            }
+            case CSEmit::STRING:
+            {
+                // the string buffer is shared by every copy of the node
+                cs->addNode(CSENode(ObjectType::STRING, string(node->getValue())), node->getOffset());
+                break;
             }
-            else if (top.get_NodeType() == ObjectType::GAMMA)
+            case CSEmit::INTEGER:
             {
-                CSENode top_of_stack = stack.returnLastNode();
+                cs->addNode(CSENode(ObjectType::INTEGER, parseInteger(node->getValue())), node->getOffset());
+                break;
+            }
+            default:
+                throw runtime_error("Invalid node type: " + string(node->getLabel()) + "Value: " + string(node->getValue()));
+            }
+        }
+    }
 
-                if (top_of_stack.get_NodeType() == ObjectType::LAMBDA)
+    void evaluate()
+    {
+        CSENode e0 = CSENode(ObjectType::ENV, 0);
+        control.push_back({-1, 0});
+        stack.addNode(e0);
+        env_stack.push_back(allocateEnv(-1, 0));
+
+        // two pending gammas of a Y* unfolding; the second, run last, applies the function
+        // in the place of the gamma that unfolded it
+        auto *etaCS = new ControlStructure(static_cast<int>(controlStructures.size()));
+        etaCS->addNode(CSENode(ObjectType::GAMMA, 1));
+        etaCS->addNode(CSENode(ObjectType::GAMMA, 0));
+        addControlStructure(etaCS);
+
+        pushCS(0);
+
+        // the node being run, for locating errors
+        const ControlStructure *running = nullptr;
+        int runningPc = 0;
+        try
+        {
+            while (true)
+            {
+                if (trackDepth)
                 {
-                    Env *new_env = new Env(envs[top_of_stack.get_ENV()]);
-                    envs[next_env++] = new_env;
-
-                    CSENode value = stack.returnLastNode();
+                    recordDepth(control.size());
+                }
+                if (profiler != nullptr && profiler->tick())
+                {
+                    sampleStack();
+                }
+                ControlFrame &frame = control.back();
 
-                    if (value.get_NodeType() == ObjectType::LAMBDA || value.get_NodeType() == ObjectType::EETA)
-                    {
-                        new_env->add_Lambda(top_of_stack.get_nodeValue(), value);
-                    }
-                    else if (value.get_NodeType() == ObjectType::STRING || value.get_NodeType() == ObjectType::INTEGER)
+                if (frame.csIndex < 0)
+                {
+                    // environment marker; e0 ends the program
+                    if (frame.pc == 0)
                     {
-                        new_env->add_variable(top_of_stack.get_nodeValue(), value);
+                        break;
                     }
-                    else if (value.get_NodeType() == ObjectType::LIST && !top_of_stack.get_IsSingleBoundVar())
-                    {
-                        vector<string> var_list = top_of_stack.get_varList();
-                        vector<CSENode> list_items = value.get_ListElements();
-
-                        vector<string> list_var;
-                        vector<CSENode> temp_list = vector<CSENode>();
+                    control.pop_back();
+                    exitEnv();
+                    continue;
+                }
+                if (frame.pc == 0)
+                {
+                    control.pop_back();
+                    continue;
+                }
 
-                        int var_count = 0;
+                const ControlStructure &current = *controlStructures[frame.csIndex];
+                const CSENode &top = current.get_Node(--frame.pc);
+                running = &current;
+                runningPc = frame.pc;
 
-                        int list_element_count = 0;
-                        bool creating_list = false;
+                if (top.get_NodeType() == ObjectType::INTEGER || top.get_NodeType() == ObjectType::STRING)
+                {
+                    stack.addNode(top);
+                }
+                else if (top.get_NodeType() == ObjectType::IDENTIFIER)
+                {
+                    lookupIdentifier(top.get_Depth(), top.get_Slot(), top.get_StringHandle());
+                }
+                else if (top.get_NodeType() == ObjectType::LAMBDA)
+                {
+                    int current_env = env_stack.back();
+                    stack.addNode(CSENode(ObjectType::LAMBDA, top.get_StringHandle(), top.get_CSIndex(), current_env));
+                }
+                else if (top.get_NodeType() == ObjectType::GAMMA)
+                {
+                    gammas++;
+                    CSENode top_of_stack = stack.returnLastNode();
 
-                        for (const auto &i : list_items)
+                    if (top_of_stack.get_NodeType() == ObjectType::LAMBDA)
+                    {
+                        if (top.get_IntValue() != 0)
                         {
-                            if (creating_list)
-                            {
-                                temp_list.push_back(i);
-                                list_element_count--;
-
-                                if (list_element_count == 0)
-                                {
-                                    new_env->add_List(var_list[var_count++], temp_list);
-                                    temp_list = vector<CSENode>();
-                                    creating_list = false;
-                                }
-                            }
-                            else
-                            {
-                                if (i.get_NodeType() == ObjectType::LIST)
-                                {
-                                    list_element_count = stoi(i.get_nodeValue());
-                                    if (list_element_count == 0)
-                                    {
-                                        new_env->add_List(var_list[var_count++], temp_list);
-                                        temp_list = vector<CSENode>();
-                                    }
-                                    else
-                                    {
-                                        creating_list = true;
-                                    }
-                                }
-                                else if (i.get_NodeType() == ObjectType::LAMBDA)
-                                {
-                                    new_env->add_Lambda(var_list[var_count++], i);
-                                }
-                                else
-                                {
-                                    new_env->add_variable(var_list[var_count++], i);
-                                }
-                            }
+                            leaveFinishedCalls();
                         }
+                        const ControlStructure &body = *controlStructures[top_of_stack.get_CSIndex()];
+                        CSENode env_obj = enterLambda(top_of_stack, body.get_varList(), body.get_IsSingleBoundVar());
 
-                        if (creating_list)
+                        control.push_back({-1, static_cast<int>(env_obj.get_IntValue())});
+                        pushCS(body.get_CSIndex());
+                    }
+                    else if (top_of_stack.get_NodeType() == ObjectType::IDENTIFIER)
+                    {
+                        if (applyBuiltin(top_of_stack))
                         {
-                            new_env->add_List(var_list[var_count], temp_list);
+                            skipControl();
                         }
                     }
-                    else if (value.get_NodeType() == ObjectType::LIST)
+                    else if (top_of_stack.get_NodeType() == ObjectType::EETA)
                     {
-                        new_env->add_List(top_of_stack.get_nodeValue(), value.get_ListElements());
+                        if (top.get_IntValue() != 0)
+                        {
+                            leaveFinishedCalls();
+                        }
+                        unfoldEeta(top_of_stack);
+                        pushCS(etaCS->get_CSIndex());
                     }
-                    else
+                    else if (top_of_stack.get_NodeType() == ObjectType::LIST)
                     {
-                        throw runtime_error("Invalid object for gamma: " + value.get_nodeValue());
+                        indexTuple(top_of_stack);
                     }
-
-                    env_stack.push_back(next_env - 1);
-                    auto *env_obj = new CSENode(ObjectType::ENV, to_string(next_env - 1));
-                    cse_machine.addNode(*env_obj);
-                    stack.addNode(*env_obj);
-                    cse_machine.addNewCS(*controlStructures[top_of_stack.get_CSIndex()]);
                 }
-                else if (top_of_stack.get_NodeType() == ObjectType::IDENTIFIER)
+                else if (top.get_NodeType() == ObjectType::OPERATOR)
+                {
+                    applyOperator(static_cast<Opcode>(top.get_IntValue()));
+                }
+                else if (top.get_NodeType() == ObjectType::TAU)
+                {
+                    buildTuple(top.get_IntValue());
+                }
+                else if (top.get_NodeType() == ObjectType::BETA)
                 {
-                    // TODO: built-in functions should be handled here
-                    string identifier = top_of_stack.get_nodeValue();
+                    // the two deltas precede the beta: else arm first, then arm below it
+                    bool condition = branchCondition();
 
-                    if (identifier == "Print" || identifier == "print")
+                    if (frame.pc < 2)
                     {
-                        CSENode value = stack.returnLastNode();
-                        vector<CSENode> listElements = value.get_ListElements();
-
-                        if (value.get_NodeType() == ObjectType::LIST)
-                        {
-                            cout << "(";
-
-                            vector<int> count_stack;
-
-                            for (int i = 0; i < value.get_ListElements().size(); i++)
-                            {
-                                if (listElements[i].get_NodeType() == ObjectType::LIST)
-                                {
-                                    count_stack.push_back(stoi(listElements[i].get_nodeValue()));
-                                    cout << "(";
-                                }
-                                else
-                                {
-                                    cout << listElements[i].get_nodeValue();
-
-                                    if (!count_stack.empty())
-                                    {
-                                        // reduce 1 from all elem_1 in count_stack
-                                        for (int &count : count_stack)
-                                        {
-                                            count--;
-                                        }
-
-                                        if (count_stack[count_stack.size() - 1] == 0)
-                                        {
-                                            if (i != value.get_ListElements().size() - 1)
-                                                cout << "), ";
-                                            else
-                                                cout << ")";
-
-                                            count_stack.pop_back();
-                                        }
-                                        else
-                                        {
-                                            if (i != value.get_ListElements().size() - 1)
-                                                cout << ", ";
-                                        }
-                                    }
-                                    else
-                                    {
-                                        if (i != value.get_ListElements().size() - 1)
-                                            cout << ", ";
-                                    }
-                                }
-                            }
-                            cout << ")";
-                        }
-                        else if (value.get_NodeType() == ObjectType::ENV || value.get_nodeValue() == "dummy")
-                        {
-                            cout << "dummy";
-                        }
-                        else if (value.get_NodeType() == ObjectType::LAMBDA)
-                        {
-                            cout << "[lambda closure: ";
-                            cout << value.get_nodeValue() << ": ";
-                            cout << value.get_CSIndex() << "]";
-                        }
-                        else
-                        {
-                            cout << value.get_nodeValue();
-                        }
+                        throw runtime_error("Invalid type for beta: missing delta");
                     }
+                    const CSENode &branch = current.get_Node(condition ? frame.pc - 2 : frame.pc - 1);
+                    frame.pc -= 2;
 
-                    else if (identifier == "Isinteger")
+                    if (branch.get_NodeType() == ObjectType::DELTA)
                     {
-                        CSENode value = stack.returnLastNode();
-                        if (value.get_NodeType() == ObjectType::INTEGER)
-                        {
-                            stack.addNode(CSENode(ObjectType::BOOLEAN, "true"));
-                        }
-                        else
-                        {
-                            stack.addNode(CSENode(ObjectType::BOOLEAN, "false"));
-                        }
+                        pushCS(branch.get_CSIndex());
                     }
-                    else if (identifier == "Isstring")
+                    else
                     {
-                        CSENode value = stack.returnLastNode();
-                        if (value.get_NodeType() == ObjectType::STRING)
-                        {
-                            stack.addNode(CSENode(ObjectType::BOOLEAN, "true"));
-                        }
-                        else
-                        {
-                            stack.addNode(CSENode(ObjectType::BOOLEAN, "false"));
-                        }
+                        throw runtime_error("Invalid type for beta: " + branch.get_nodeValue());
                     }
-                    else if (identifier == "Isempty")
+                }
+            }
+        }
+        catch (...)
+        {
+            rethrowAt(running != nullptr ? running->get_Offset(runningPc) : NO_OFFSET);
+        }
+    }
+
+    // run a compiled program; produces the same output as createCS followed by evaluate
+    void execute(const BytecodeProgram &program)
+    {
+        CSENode e0 = CSENode(ObjectType::ENV, 0);
+        stack.addNode(e0);
+        env_stack.push_back(allocateEnv(-1, 0));
+
+        const Instr *code = program.instructions();
+        const vector<Block> &blocks = program.blocks;
+        vector<int> returns; // return addresses of entered blocks
+        int pc = blocks[0].start;
+
+        try
+        {
+#if defined(__GNUC__)
+#define RPAL_THREADED_DISPATCH
+#endif
+
+#ifdef RPAL_THREADED_DISPATCH
+            // labels in Opcode order
+            static const void *dispatch[] = {
+                &&op_PUSH_INT, &&op_PUSH_STR, &&op_LOAD, &&op_PUSH_LAMBDA, &&op_GAMMA, &&op_TAU, &&op_BRANCH,
+                &&op_ADD, &&op_SUB, &&op_MUL, &&op_DIV, &&op_EQ, &&op_NE, &&op_GR, &&op_GE, &&op_LS, &&op_LE,
+                &&op_OR, &&op_AND, &&op_AUG, &&op_NEG, &&op_NOT, &&op_END, &&op_EXIT_ENV, &&op_HALT};
+#define CASE(name) op_##name:
+#define DISPATCH()                                     \
+    do                                                 \
+    {                                                  \
+        if (trackDepth)                                \
+        {                                              \
+            recordDepth(returns.size());               \
+        }                                              \
+        goto *dispatch[static_cast<int>(code[pc].op)]; \
+    } while (0)
+            DISPATCH();
+#else
+#define CASE(name) case Opcode::name:
+#define DISPATCH() continue
+            for (;;)
+            {
+                if (trackDepth)
+                {
+                    recordDepth(returns.size());
+                }
+                switch (code[pc].op)
+                {
+#endif
+
+            CASE(PUSH_INT)
+            {
+                stack.addNode(CSENode(ObjectType::INTEGER, program.integers[code[pc++].a]));
+                DISPATCH();
+            }
+            CASE(PUSH_STR)
+            {
+                stack.addNode(CSENode(ObjectType::STRING, program.strings[code[pc++].a]));
+                DISPATCH();
+            }
+            CASE(LOAD)
+            {
+                const Instr &instr = code[pc++];
+                lookupIdentifier(instr.a, instr.b, program.names[instr.c]);
+                DISPATCH();
+            }
+            CASE(PUSH_LAMBDA)
+            {
+                int block = code[pc++].a;
+                stack.addNode(CSENode(ObjectType::LAMBDA, blocks[block].boundName, block, env_stack.back()));
+                DISPATCH();
+            }
+            CASE(GAMMA)
+            {
+                pc++;
+                gammas++;
+                // a computed goto leaves the case without running destructors, so the operator is
+                // scoped to an inner block that ends before DISPATCH
+                {
+                    CSENode rator = stack.returnLastNode();
+
+                    // where the call returns to; a call in tail position first leaves the branches
+                    // and bodies that would end right after it, as leaveFinishedCalls does
+                    int resume = pc;
+                    if (code[pc - 1].b != 0 &&
+                        (rator.get_NodeType() == ObjectType::LAMBDA || rator.get_NodeType() == ObjectType::EETA))
                     {
-                        CSENode value = stack.returnLastNode();
-                        if (value.get_NodeType() == ObjectType::LIST)
+                        while (code[resume].op == Opcode::END || code[resume].op == Opcode::EXIT_ENV)
                         {
-                            if (value.get_ListElements().empty())
+                            if (code[resume].op == Opcode::EXIT_ENV)
                             {
-                                stack.addNode(CSENode(ObjectType::BOOLEAN, "true"));
+                                exitEnv();
                             }
-                            else
-                            {
-                                stack.addNode(CSENode(ObjectType::BOOLEAN, "false"));
-                            }
-                        }
-                        else
-                        {
-                            throw runtime_error("Invalid type for IsEmpty: " + value.get_nodeValue());
+                            resume = returns.back();
+                            returns.pop_back();
                         }
                     }
-                    else if (identifier == "Istuple")
+
+                    if (rator.get_NodeType() == ObjectType::LAMBDA)
                     {
-                        CSENode value = stack.returnLastNode();
+                        const Block &body = blocks[rator.get_CSIndex()];
+                        enterLambda(rator, body.boundVariables, body.isSingleBoundVar);
 
-                        if (value.get_NodeType() == ObjectType::LIST)
-                        {
-                            stack.addNode(CSENode(ObjectType::BOOLEAN, "true"));
-                        }
-                        else
-                        {
-                            stack.addNode(CSENode(ObjectType::BOOLEAN, "false"));
-                        }
+                        returns.push_back(resume);
+                        pc = body.start;
                     }
-                    else if (identifier == "Order")
+                    else if (rator.get_NodeType() == ObjectType::IDENTIFIER)
                     {
-                        CSENode value = stack.returnLastNode();
-                        if (value.get_NodeType() == ObjectType::LIST)
+                        if (applyBuiltin(rator))
                         {
-                            int count = 0;
-                            int list_elem_skip = 0;
-
-                            for (const auto &i : value.get_ListElements())
+                            // Conc consumes the gamma of its second argument
+                            if (code[pc].op != Opcode::GAMMA)
                             {
-                                if (i.get_NodeType() == ObjectType::LIST && list_elem_skip == 0)
-                                {
-                                    list_elem_skip += stoi(i.get_nodeValue());
-                                    count++;
-                                }
-                                else if (list_elem_skip == 0)
-                                {
-                                    count++;
-                                }
-                                else
-                                {
-                                    list_elem_skip--;
-                                    continue;
-                                }
+                                throw runtime_error("Conc expects two arguments");
                             }
-
-                            stack.addNode(CSENode(ObjectType::INTEGER, to_string(count)));
-                        }
-                        else
-                        {
-                            throw runtime_error("Invalid type for Order: " + value.get_nodeValue());
+                            pc++;
                         }
                     }
-                    else if (identifier == "Conc")
+                    else if (rator.get_NodeType() == ObjectType::EETA)
                     {
-                        CSENode first_arg = stack.returnLastNode();
-                        CSENode second_arg = stack.returnLastNode();
-                        cse_machine.popLastNode();
+                        unfoldEeta(rator);
 
-                        if (first_arg.get_NodeType() == ObjectType::STRING &&
-                            (second_arg.get_NodeType() == ObjectType::STRING ||
-                             second_arg.get_NodeType() == ObjectType::INTEGER))
-                        {
-                            stack.addNode(
-                                CSENode(ObjectType::STRING, first_arg.get_nodeValue() + second_arg.get_nodeValue()));
-                        }
-                        else
-                        {
-                            throw runtime_error("Invalid type for Conc: " + first_arg.get_nodeValue());
-                        }
+                        returns.push_back(resume);
+                        pc = blocks[program.etaBlock].start;
                     }
-                    else if (identifier == "Stem")
+                    else if (rator.get_NodeType() == ObjectType::LIST)
                     {
-                        CSENode arg = stack.returnLastNode();
-
-                        if (arg.get_NodeType() == ObjectType::STRING)
-                        {
-                            stack.addNode(CSENode(ObjectType::STRING, arg.get_nodeValue().substr(0, 1)));
-                        }
-                        else
-                        {
-                            throw runtime_error("Invalid type for Stem: " + top_of_stack.get_nodeValue());
-                        }
+                        indexTuple(rator);
                     }
+                }
+                DISPATCH();
+            }
+            CASE(TAU)
+            {
+                buildTuple(code[pc++].a);
+                DISPATCH();
+            }
+            CASE(BRANCH)
+            {
+                const Instr &instr = code[pc++];
+                returns.push_back(pc);
+                pc = branchCondition() ? instr.a : instr.b;
+                DISPATCH();
+            }
+            CASE(ADD)
+            {
+                pc++;
+                arithmetic(Opcode::ADD, "+");
+                DISPATCH();
+            }
+            CASE(SUB)
+            {
+                pc++;
+                arithmetic(Opcode::SUB, "-");
+                DISPATCH();
+            }
+            CASE(MUL)
+            {
+                pc++;
+                arithmetic(Opcode::MUL, "*");
+                DISPATCH();
+            }
+            CASE(DIV)
+            {
+                pc++;
+                arithmetic(Opcode::DIV, "/");
+                DISPATCH();
+            }
+            CASE(EQ)
+            {
+                pc++;
+                compare(Opcode::EQ, "eq");
+                DISPATCH();
+            }
+            CASE(NE)
+            {
+                pc++;
+                compare(Opcode::NE, "ne");
+                DISPATCH();
+            }
+            CASE(GR)
+            {
+                pc++;
+                compare(Opcode::GR, "gr");
+                DISPATCH();
+            }
+            CASE(GE)
+            {
+                pc++;
+                compare(Opcode::GE, "ge");
+                DISPATCH();
+            }
+            CASE(LS)
+            {
+                pc++;
+                compare(Opcode::LS, "ls");
+                DISPATCH();
+            }
+            CASE(LE)
+            {
+                pc++;
+                compare(Opcode::LE, "le");
+                DISPATCH();
+            }
+            CASE(OR)
+            {
+                pc++;
+                applyOperator(Opcode::OR);
+                DISPATCH();
+            }
+            CASE(AND)
+            {
+                pc++;
+                applyOperator(Opcode::AND);
+                DISPATCH();
+            }
+            CASE(AUG)
+            {
+                pc++;
+                applyOperator(Opcode::AUG);
+                DISPATCH();
+            }
+            CASE(NEG)
+            {
+                pc++;
+                applyOperator(Opcode::NEG);
+                DISPATCH();
+            }
+            CASE(NOT)
+            {
+                pc++;
+                applyOperator(Opcode::NOT);
+                DISPATCH();
+            }
+            CASE(END)
+            {
+                pc = returns.back();
+                returns.pop_back();
+                DISPATCH();
+            }
+            CASE(EXIT_ENV)
+            {
+                exitEnv();
+                pc = returns.back();
+                returns.pop_back();
+                DISPATCH();
+            }
+            CASE(HALT)
+            {
+                return;
+            }
 
-                    else if (identifier == "Stern")
-                    {
-                        CSENode arg = stack.returnLastNode();
+#ifndef RPAL_THREADED_DISPATCH
+                }
+            }
+#endif
+        }
+        catch (...)
+        {
+            // every instruction steps past itself before it can fail
+            rethrowAt(pc > 0 ? program.sourceOffsets()[pc - 1] : NO_OFFSET);
+        }
+#undef CASE
+#undef DISPATCH
+    }
 
-                        if (arg.get_NodeType() == ObjectType::STRING)
-                        {
-                            stack.addNode(CSENode(ObjectType::STRING, arg.get_nodeValue().substr(1)));
-                        }
-                        else
-                        {
-                            throw runtime_error("Invalid type for Stern: " + top_of_stack.get_nodeValue());
-                        }
-                    }
-                    else if (identifier == "Y*")
-                    {
-                        CSENode lambda = stack.returnLastNode();
+private:
+    // push the value bound to an identifier; free identifiers were resolved to built-ins at compile time
+    void lookupIdentifier(int depth, int slot, const shared_ptr<const string> &name)
+    {
+        if (depth >= 0)
+        {
+            const CSENode *value = envs[env_stack.back()]->lookup(depth, slot);
 
-                        if (lambda.get_NodeType() == ObjectType::LAMBDA)
-                        {
-                            if (lambda.get_IsSingleBoundVar())
-                            {
-                                stack.addNode(CSENode(ObjectType::EETA, lambda.get_nodeValue(), lambda.get_CSIndex(), lambda.get_ENV()));
-                            }
-                            else
-                            {
-                                stack.addNode(CSENode(ObjectType::EETA, lambda.get_CSIndex(), lambda.get_varList(), lambda.get_ENV()));
-                            }
-                        }
-                        else
-                        {
-                            throw runtime_error("Invalid type for Y*: " + lambda.get_nodeValue());
-                        }
-                    }
-                    else if (identifier == "ItoS")
-                    {
-                        CSENode arg = stack.returnLastNode();
+            if (value == nullptr)
+            {
+                throw runtime_error("Variable not found: " + *name);
+            }
+            stack.addNode(*value);
+        }
+        else if (slot == static_cast<int>(Builtin::NIL))
+        {
+            stack.addNode(CSENode(ObjectType::LIST, vector<CSENode>()));
+        }
+        else if (slot >= 0)
+        {
+            // built-in functions stay on the stack as identifiers carrying their code
+            stack.addNode(CSENode(ObjectType::IDENTIFIER, -1, slot, name));
+        }
+        else
+        {
+            throw runtime_error("Variable not found: " + *name);
+        }
+    }
 
-                        if (arg.get_NodeType() == ObjectType::INTEGER)
-                        {
-                            stack.addNode(CSENode(ObjectType::STRING, arg.get_nodeValue()));
-                        }
-                        else
-                        {
-                            throw runtime_error("Invalid type for ItoS: " + arg.get_nodeValue());
-                        }
-                    }
-                }
-                else if (top_of_stack.get_NodeType() == ObjectType::EETA)
-                {
-                    stack.addNode(top_of_stack);
+    // apply a closure to the value below it: create its environment, bind the arguments and
+    // mark the new environment on the stack; returns the env marker
+    CSENode enterLambda(const CSENode &closure, const vector<string> &var_list, bool isSingleBoundVar)
+    {
+        int new_id = allocateEnv(closure.get_ENV(), static_cast<int>(var_list.size()));
+        Env *new_env = envs[new_id];
 
-                    if (top_of_stack.get_IsSingleBoundVar())
-                    {
-                        stack.addNode(
-                            CSENode(ObjectType::LAMBDA, top_of_stack.get_nodeValue(), top_of_stack.get_CSIndex(),
-                                    top_of_stack.get_ENV()));
-                    }
-                    else
-                    {
-                        stack.addNode(
-                            CSENode(ObjectType::LAMBDA, top_of_stack.get_CSIndex(), top_of_stack.get_varList(),
-                                    top_of_stack.get_ENV()));
-                    }
+        CSENode value = stack.returnLastNode();
 
-                    cse_machine.addNode(CSENode(ObjectType::GAMMA, ""));
-                    cse_machine.addNode(CSENode(ObjectType::GAMMA, ""));
-                }
-                else if (top_of_stack.get_NodeType() == ObjectType::LIST)
-                {
-                    CSENode second_arg = stack.returnLastNode();
+        if (value.get_NodeType() == ObjectType::LIST && !isSingleBoundVar)
+        {
+            // one element per variable
+            for (long long i = 0; i < value.get_Order(); i++)
+            {
+                new_env->bind(static_cast<int>(i), value.get_Element(i));
+            }
+        }
+        else if (!isSingleBoundVar)
+        {
+            // nothing to destructure; the variables stay unbound
+        }
+        else if (value.get_NodeType() == ObjectType::LAMBDA || value.get_NodeType() == ObjectType::EETA ||
+                 value.get_NodeType() == ObjectType::STRING || value.get_NodeType() == ObjectType::INTEGER ||
+                 value.get_NodeType() == ObjectType::BOOLEAN || value.get_NodeType() == ObjectType::LIST ||
+                 value.get_NodeType() == ObjectType::IDENTIFIER)
+        {
+            // identifiers here are built-ins and dummy, which are values like any other
+            new_env->bind(0, value);
+        }
+        else
+        {
+            throw runtime_error("Invalid object for gamma: " + value.get_nodeValue());
+        }
 
-                    if (second_arg.get_NodeType() == ObjectType::INTEGER)
-                    {
-                        int index = stoi(second_arg.get_nodeValue());
+        env_stack.push_back(new_id);
+        CSENode env_obj = CSENode(ObjectType::ENV, new_id);
+        stack.addNode(env_obj);
+        return env_obj;
+    }
 
-                        int current_index = 0;
-                        int list_element_pos = 0;
-                        int list_elem_skip = 0;
-                        bool is_list = false;
+    // leave the current environment, keeping the values computed above its stack marker
+    void exitEnv()
+    {
+        vector<CSENode> env_nodes = {};
 
-                        for (const auto &i : top_of_stack.get_ListElements())
-                        {
-                            if (i.get_NodeType() == ObjectType::LIST && list_elem_skip == 0)
-                            {
-                                list_elem_skip = stoi(i.get_nodeValue());
-                                current_index++;
-
-                                if (index == current_index)
-                                {
-                                    is_list = true;
-                                    break;
-                                }
-                            }
-                            else if (list_elem_skip == 0)
-                            {
-                                current_index++;
+        CSENode st_node = stack.returnLastNode();
 
-                                if (index == current_index)
-                                {
-                                    break;
-                                }
-                            }
-                            else
-                            {
-                                list_elem_skip--;
-                            }
-                            list_element_pos++;
-                        }
+        while (st_node.get_NodeType() != ObjectType::ENV)
+        {
+            env_nodes.push_back(st_node);
+            st_node = stack.returnLastNode();
+        }
 
-                        vector<CSENode> listElements = vector<CSENode>();
+        // push back the stack from vector
+        for (auto it = env_nodes.rbegin(); it != env_nodes.rend(); ++it)
+        {
+            stack.addNode(*it);
+        }
 
-                        if (is_list)
-                        {
-                            int length = stoi(top_of_stack.get_ListElements()[list_element_pos].get_nodeValue());
+        env_stack.pop_back();
+    }
 
-                            for (int i = 0; i < length; i++)
-                            {
-                                listElements.push_back(top_of_stack.get_ListElements()[list_element_pos + i + 1]);
-                            }
+    // Y* unfolding: leaves the eeta and its lambda on the stack for two gammas
+    void unfoldEeta(const CSENode &eeta)
+    {
+        stack.addNode(eeta);
+        stack.addNode(CSENode(ObjectType::LAMBDA, eeta.get_StringHandle(), eeta.get_CSIndex(), eeta.get_ENV()));
+    }
 
-                            stack.addNode(CSENode(ObjectType::LIST, listElements));
-                        }
-                        else
-                        {
-                            stack.addNode(top_of_stack.get_ListElements()[list_element_pos]);
-                        }
-                    }
-                    else
-                    {
-                        throw runtime_error("Invalid type for Index: " + second_arg.get_nodeValue());
-                    }
-                }
+    // pop the condition of a beta
+    bool branchCondition()
+    {
+        CSENode node = stack.returnLastNode();
+
+        if (node.get_NodeType() == ObjectType::BOOLEAN || node.get_NodeType() == ObjectType::INTEGER)
+        {
+            return node.get_BoolValue();
+        }
+        throw runtime_error("Invalid type for beta: " + node.get_nodeValue());
+    }
+
+    static void requireIntegers(const string &biop, const CSENode &val_1, const CSENode &val_2)
+    {
+        if (val_1.get_NodeType() != ObjectType::INTEGER || val_2.get_NodeType() != ObjectType::INTEGER)
+        {
+            throw invalid_argument("Invalid operands for " + biop + ": " + val_1.get_nodeValue() + ", " + val_2.get_nodeValue());
+        }
+    }
+
+    static void requireComparable(const CSENode &val_1, const CSENode &val_2)
+    {
+        if (val_1.get_NodeType() != val_2.get_NodeType() ||
+            (val_1.get_NodeType() != ObjectType::INTEGER && val_1.get_NodeType() != ObjectType::BOOLEAN))
+        {
+            throw invalid_argument("Invalid numeric inputs.");
+        }
+    }
+
+    // apply the operator of an OPERATOR control node
+    void applyOperator(Opcode code)
+    {
+        switch (code)
+        {
+        case Opcode::ADD:
+            arithmetic(code, "+");
+            break;
+        case Opcode::SUB:
+            arithmetic(code, "-");
+            break;
+        case Opcode::MUL:
+            arithmetic(code, "*");
+            break;
+        case Opcode::DIV:
+            arithmetic(code, "/");
+            break;
+        case Opcode::EQ:
+            compare(code, "eq");
+            break;
+        case Opcode::NE:
+            compare(code, "ne");
+            break;
+        case Opcode::GR:
+            compare(code, "gr");
+            break;
+        case Opcode::GE:
+            compare(code, "ge");
+            break;
+        case Opcode::LS:
+            compare(code, "ls");
+            break;
+        case Opcode::LE:
+            compare(code, "le");
+            break;
+        case Opcode::OR:
+        case Opcode::AND:
+        {
+            CSENode val_1 = stack.returnLastNode();
+            CSENode val_2 = stack.returnLastNode();
+            bool result = code == Opcode::OR ? isTruthy(val_1) || isTruthy(val_2) : isTruthy(val_1) && isTruthy(val_2);
+            stack.addNode(CSENode(ObjectType::BOOLEAN, result));
+            break;
+        }
+        case Opcode::AUG:
+        {
+            CSENode val_1 = stack.returnLastNode();
+            CSENode val_2 = stack.returnLastNode();
+            augment(val_1, val_2);
+            break;
+        }
+        case Opcode::NEG:
+        {
+            CSENode val_1 = stack.returnLastNode();
+            requireIntegers("neg", val_1, val_1);
+            stack.addNode(CSENode(ObjectType::INTEGER, -val_1.get_IntValue()));
+            break;
+        }
+        case Opcode::NOT:
+        {
+            CSENode val_1 = stack.returnLastNode();
+            stack.addNode(CSENode(ObjectType::BOOLEAN, !isTruthy(val_1)));
+            break;
+        }
+        default:
+            throw runtime_error("Invalid operator");
+        }
+    }
+
+    // integer arithmetic of the bytecode machine
+    void arithmetic(Opcode code, const char *biop)
+    {
+        CSENode val_1 = stack.returnLastNode();
+        CSENode val_2 = stack.returnLastNode();
+        requireIntegers(biop, val_1, val_2);
+
+        long long a = val_1.get_IntValue();
+        long long b = val_2.get_IntValue();
+        long long result;
 
-                top = cse_machine.returnLastNode();
+        switch (code)
+        {
+        case Opcode::ADD:
+            result = a + b;
+            break;
+        case Opcode::SUB:
+            result = a - b;
+            break;
+        case Opcode::MUL:
+            result = a * b;
+            break;
+        default:
+            if (b == 0)
+            {
+                throw runtime_error("Division by zero is not allowed.");
             }
-            else if (top.get_NodeType() == ObjectType::ENV)
+            result = a / b;
+            break;
+        }
+        stack.addNode(CSENode(ObjectType::INTEGER, result));
+    }
+
+    // comparisons of the bytecode machine
+    void compare(Opcode code, const char *biop)
+    {
+        CSENode val_1 = stack.returnLastNode();
+        CSENode val_2 = stack.returnLastNode();
+        bool result;
+
+        if (val_1.get_NodeType() == ObjectType::STRING && val_2.get_NodeType() == ObjectType::STRING)
+        {
+            result = stringops(biop, val_1.get_StringView(), val_2.get_StringView());
+        }
+        else
+        {
+            requireComparable(val_1, val_2);
+            long long a = val_1.get_IntValue();
+            long long b = val_2.get_IntValue();
+
+            switch (code)
             {
-                vector<CSENode> env_nodes = {};
+            case Opcode::EQ:
+                result = a == b;
+                break;
+            case Opcode::NE:
+                result = a != b;
+                break;
+            case Opcode::GR:
+                result = a > b;
+                break;
+            case Opcode::GE:
+                result = a >= b;
+                break;
+            case Opcode::LS:
+                result = a < b;
+                break;
+            default:
+                result = a <= b;
+                break;
+            }
+        }
+        stack.addNode(CSENode(ObjectType::BOOLEAN, result));
+    }
 
-                CSENode st_node = stack.returnLastNode();
+    // whether a value holds the elements buffer, directly or through nested tuples
+    static bool reachesBuffer(const CSENode &value, const vector<CSENode> *buffer)
+    {
+        if (value.get_NodeType() != ObjectType::LIST || value.get_TupleBuffer() == nullptr)
+        {
+            return false;
+        }
 
-                while (st_node.get_NodeType() != ObjectType::ENV)
+        vector<const vector<CSENode> *> pending = {value.get_TupleBuffer().get()};
+        unordered_set<const vector<CSENode> *> seen;
+        while (!pending.empty())
+        {
+            const vector<CSENode> *elements = pending.back();
+            pending.pop_back();
+            if (elements == buffer)
+            {
+                return true;
+            }
+            if (!seen.insert(elements).second)
+            {
+                continue;
+            }
+            // the whole buffer is owned, not only the part a tuple sees
+            for (const CSENode &element : *elements)
+            {
+                if (element.get_NodeType() == ObjectType::LIST && element.get_TupleBuffer() != nullptr)
                 {
-                    env_nodes.push_back(st_node);
-                    st_node = stack.returnLastNode();
+                    pending.push_back(element.get_TupleBuffer().get());
                 }
+            }
+        }
+        return false;
+    }
+
+    // tuple aug value; the new tuple shares the elements of val_1 and, when val_1 ends its buffer,
+    // appends in place so building a tuple by repeated aug is linear
+    void augment(const CSENode &val_1, const CSENode &val_2)
+    {
+        if (val_1.get_NodeType() == ObjectType::LIST)
+        {
+            if (val_2.get_NodeType() != ObjectType::LIST && val_2.get_NodeType() != ObjectType::INTEGER &&
+                val_2.get_NodeType() != ObjectType::BOOLEAN && val_2.get_NodeType() != ObjectType::STRING &&
+                val_2.get_NodeType() != ObjectType::LAMBDA && val_2.get_NodeType() != ObjectType::EETA)
+            {
+                throw runtime_error("Invalid type for aug: " + val_2.get_nodeValue());
+            }
 
-                // push back the stack from vector
-                for (auto it = env_nodes.rbegin(); it != env_nodes.rend(); ++it)
+            long long order = val_1.get_Order();
+            shared_ptr<vector<CSENode>> buffer = val_1.get_TupleBuffer();
+
+            // a longer tuple already extends this prefix, or the value holds the buffer and appending
+            // would make the buffer own itself. Only a buffer held beyond val_1 and this handle can
+            // be reached from the value, so a fresh one, such as that of nil, is not searched.
+            if (buffer == nullptr || buffer->size() != static_cast<size_t>(order) ||
+                (buffer.use_count() > 2 && reachesBuffer(val_2, buffer.get())))
+            {
+                auto copy = make_shared<vector<CSENode>>();
+                copy->reserve(order + 1);
+                for (long long i = 0; i < order; i++)
                 {
-                    stack.addNode(*it);
+                    copy->push_back(val_1.get_Element(i));
                 }
+                buffer = move(copy);
+            }
 
-                env_stack.pop_back();
+            buffer->push_back(val_2);
+            stack.addNode(CSENode(ObjectType::LIST, move(buffer), order + 1));
+        }
+        else
+        {
+            throw runtime_error("Invalid type for aug: " + val_1.get_nodeValue());
+        }
+    }
 
-                top = cse_machine.returnLastNode();
-            }
-            else if (top.get_NodeType() == ObjectType::OPERATOR)
+    // pop tau_size values into a tuple
+    void buildTuple(long long tau_size)
+    {
+        vector<CSENode> new_elem;
+        new_elem.reserve(tau_size);
+
+        for (long long i = 0; i < tau_size; i++)
+        {
+            new_elem.push_back(stack.returnLastNode());
+        }
+
+        stack.addNode(CSENode(ObjectType::LIST, move(new_elem)));
+    }
+
+    // apply a tuple to the index below it
+    void indexTuple(const CSENode &top_of_stack)
+    {
+        CSENode second_arg = stack.returnLastNode();
+
+        if (second_arg.get_NodeType() == ObjectType::INTEGER)
+        {
+            long long index = second_arg.get_IntValue();
+
+            if (index < 1 || index > top_of_stack.get_Order())
             {
-                string biop = top.get_nodeValue();
+                throw runtime_error("Invalid index for tuple: " + to_string(index));
+            }
+            stack.addNode(top_of_stack.get_Element(index - 1));
+        }
+        else
+        {
+            throw runtime_error("Invalid type for Index: " + second_arg.get_nodeValue());
+        }
+    }
 
-                CSENode val_1 = stack.returnLastNode();
-                CSENode val_2 = stack.returnLastNode();
+    // textual form of a value, written without building a string for integers and strings
+    void printValue(const CSENode &value)
+    {
+        if (value.get_NodeType() == ObjectType::INTEGER)
+        {
+            out->writeInteger(value.get_IntValue());
+        }
+        else if (value.get_NodeType() == ObjectType::STRING)
+        {
+            // strings are materialized only here
+            out->write(value.get_StringView());
+        }
+        else
+        {
+            out->write(value.get_nodeValue());
+        }
+    }
 
-                if (biop == "+" || biop == "-" || biop == "/" || biop == "*")
-                {
-                    stack.addNode(CSENode(ObjectType::INTEGER, op(biop, val_1.get_nodeValue(), val_2.get_nodeValue())));
-                }
+    // nested tuples are printed from an explicit stack of (tuple, next element), so nesting depth
+    // is bounded only by memory
+    void print(const CSENode &value)
+    {
+        if (value.get_NodeType() == ObjectType::LIST)
+        {
+            vector<pair<const CSENode *, long long>> open = {{&value, 0}};
+            out->write('(');
 
-                else if (biop == "neg")
+            while (!open.empty())
+            {
+                const CSENode *tuple = open.back().first;
+                long long i = open.back().second++;
+
+                if (i == tuple->get_Order())
                 {
-                    stack.addNode(val_2);
-                    stack.addNode(CSENode(ObjectType::INTEGER, unop(biop, val_1.get_nodeValue())));
+                    out->write(')');
+                    open.pop_back();
+                    continue;
                 }
-                else if (biop == "not")
+                if (i > 0)
                 {
-                    stack.addNode(val_2);
-                    stack.addNode(CSENode(ObjectType::BOOLEAN, unop(biop, val_1.get_nodeValue())));
+                    out->write(", ");
                 }
-                else if (biop == "aug")
-                {
-                    if (val_1.get_NodeType() == ObjectType::LIST)
-                    {
-                        if (val_2.get_NodeType() == ObjectType::LIST)
-                        {
-                            vector<CSENode> elem_1 = val_1.get_ListElements();
-                            vector<CSENode> elem_2 = val_2.get_ListElements();
-
-                            elem_1.emplace_back(ObjectType::LIST, to_string(elem_2.size()));
 
-                            for (auto &element : elem_2)
-                            {
-                                elem_1.push_back(element);
-                            }
-
-                            stack.addNode(CSENode(ObjectType::LIST, elem_1));
-                        }
-                        else if (val_2.get_NodeType() == ObjectType::INTEGER ||
-                                 val_2.get_NodeType() == ObjectType::BOOLEAN ||
-                                 val_2.get_NodeType() == ObjectType::STRING)
-                        {
-                            vector<CSENode> elem_1 = val_1.get_ListElements();
-
-                            elem_1.emplace_back(val_2.get_NodeType(), val_2.get_nodeValue());
-                            stack.addNode(CSENode(ObjectType::LIST, elem_1));
-                        }
-                        else
-                        {
-                            throw runtime_error("Invalid type for aug: " + val_2.get_nodeValue());
-                        }
-                    }
+                const CSENode &element = tuple->get_Element(i);
+                if (element.get_NodeType() == ObjectType::LIST)
+                {
+                    out->write('(');
+                    open.push_back({&element, 0});
                 }
                 else
                 {
-                    // handle boolena values
-                    stack.addNode(CSENode(ObjectType::BOOLEAN, booleanops(biop, val_1.get_nodeValue(), val_2.get_nodeValue())));
+                    printValue(element);
                 }
-
-                top = cse_machine.returnLastNode();
             }
-            else if (top.get_NodeType() == ObjectType::TAU)
-            {
-                vector<CSENode> new_elem;
-                int tau_size = stoi(top.get_nodeValue());
+        }
+        else if (value.get_NodeType() == ObjectType::ENV ||
+                 (value.get_NodeType() != ObjectType::INTEGER && value.get_NodeType() != ObjectType::STRING &&
+                  value.get_nodeValue() == "dummy"))
+        {
+            out->write("dummy");
+        }
+        else if (value.get_NodeType() == ObjectType::LAMBDA)
+        {
+            out->write("[lambda closure: ");
+            out->write(value.get_String());
+            out->write(": ");
+            out->writeInteger(value.get_CSIndex());
+            out->write(']');
+        }
+        else
+        {
+            printValue(value);
+        }
+    }
 
-                for (int i = 0; i < tau_size; i++)
-                {
-                    CSENode node = stack.returnLastNode();
+    // Conc: appends to the buffer of first when first ends it, otherwise starts a new buffer;
+    // left-nested Conc chains are therefore linear
+    static CSENode concatenate(const CSENode &first, const CSENode &second)
+    {
+        string suffix = second.get_nodeValue();
 
-                    if (node.get_NodeType() == ObjectType::LIST)
-                    {
-                        vector<CSENode> elem_1 = node.get_ListElements();
-                        new_elem.emplace_back(ObjectType::LIST, to_string(elem_1.size()));
+        if (first.get_IsBufferTail())
+        {
+            // runtime buffers are created non-const, so extending one is well defined
+            const_pointer_cast<string>(first.get_StringHandle())->append(suffix);
+            return CSENode::slice(first.get_StringHandle(), first.get_ENV(), first.get_IntValue() + suffix.size(), true);
+        }
 
-                        for (auto &element : elem_1)
-                        {
-                            new_elem.push_back(element);
-                        }
-                    }
-                    else
-                    {
-                        new_elem.push_back(node);
-                    }
-                }
+        auto buffer = make_shared<string>();
+        buffer->append(first.get_StringView());
+        buffer->append(suffix);
 
-                stack.addNode(CSENode(ObjectType::LIST, new_elem));
+        long long length = static_cast<long long>(buffer->size());
+        return CSENode::slice(move(buffer), 0, length, true);
+    }
 
-                top = cse_machine.returnLastNode();
+    // apply a built-in function; returns true when it also consumed the next gamma
+    bool applyBuiltin(const CSENode &top_of_stack)
+    {
+        switch (static_cast<Builtin>(top_of_stack.get_Slot()))
+        {
+        case Builtin::PRINT:
+        {
+            print(stack.returnLastNode());
+            // Print returns dummy, so it may appear inside a tuple or as an argument
+            stack.addNode(CSENode(ObjectType::IDENTIFIER, -1, static_cast<int>(Builtin::DUMMY), dummyName));
+            break;
+        }
+        case Builtin::ISINTEGER:
+        {
+            CSENode value = stack.returnLastNode();
+            stack.addNode(CSENode(ObjectType::BOOLEAN, value.get_NodeType() == ObjectType::INTEGER));
+            break;
+        }
+        case Builtin::ISSTRING:
+        {
+            CSENode value = stack.returnLastNode();
+            stack.addNode(CSENode(ObjectType::BOOLEAN, value.get_NodeType() == ObjectType::STRING));
+            break;
+        }
+        case Builtin::ISEMPTY:
+        {
+            CSENode value = stack.returnLastNode();
+            if (value.get_NodeType() == ObjectType::LIST)
+            {
+                stack.addNode(CSENode(ObjectType::BOOLEAN, value.get_Order() == 0));
             }
-            else if (top.get_NodeType() == ObjectType::BETA)
+            else
             {
-                CSENode node = stack.returnLastNode();
-
-                if (node.get_NodeType() == ObjectType::BOOLEAN)
-                {
-                    if (node.get_nodeValue() == "true")
-                    {
-                        cse_machine.popLastNode();
-                        CSENode true_node = cse_machine.returnLastNode();
+                throw runtime_error("Invalid type for IsEmpty: " + value.get_nodeValue());
+            }
+            break;
+        }
+        case Builtin::ISTUPLE:
+        {
+            CSENode value = stack.returnLastNode();
+            stack.addNode(CSENode(ObjectType::BOOLEAN, value.get_NodeType() == ObjectType::LIST));
+            break;
+        }
+        case Builtin::ORDER:
+        {
+            CSENode value = stack.returnLastNode();
+            if (value.get_NodeType() == ObjectType::LIST)
+            {
+                stack.addNode(CSENode(ObjectType::INTEGER, value.get_Order()));
+            }
+            else
+            {
+                throw runtime_error("Invalid type for Order: " + value.get_nodeValue());
+            }
+            break;
+        }
+        case Builtin::CONC:
+        {
+            CSENode first_arg = stack.returnLastNode();
+            CSENode second_arg = stack.returnLastNode();
 
-                        if (true_node.get_NodeType() == ObjectType::DELTA)
-                        {
-                            cse_machine.addNewCS(*controlStructures[stoi(true_node.get_nodeValue())]);
-                        }
-                        else
-                        {
-                            throw runtime_error("Invalid type for beta: " + true_node.get_nodeValue());
-                        }
-                    }
-                    else
-                    {
-                        CSENode false_node = cse_machine.returnLastNode();
-                        cse_machine.popLastNode();
+            if (first_arg.get_NodeType() == ObjectType::STRING &&
+                (second_arg.get_NodeType() == ObjectType::STRING ||
+                 second_arg.get_NodeType() == ObjectType::INTEGER))
+            {
+                stack.addNode(concatenate(first_arg, second_arg));
+            }
+            else
+            {
+                throw runtime_error("Invalid type for Conc: " + first_arg.get_nodeValue());
+            }
+            return true;
+        }
+        case Builtin::STEM:
+        {
+            CSENode arg = stack.returnLastNode();
 
-                        if (false_node.get_NodeType() == ObjectType::DELTA)
-                        {
-                            cse_machine.addNewCS(*controlStructures[stoi(false_node.get_nodeValue())]);
-                        }
-                        else
-                        {
-                            throw runtime_error("Invalid type for beta: " + false_node.get_nodeValue());
-                        }
-                    }
-                }
-                else if (node.get_NodeType() == ObjectType::INTEGER)
-                {
-                    if (node.get_nodeValue() != "0")
-                    {
-                        cse_machine.popLastNode();
-                        CSENode true_node = cse_machine.returnLastNode();
+            if (arg.get_NodeType() == ObjectType::STRING)
+            {
+                stack.addNode(CSENode::slice(arg.get_StringHandle(), arg.get_ENV(), min(1LL, arg.get_IntValue()), false));
+            }
+            else
+            {
+                throw runtime_error("Invalid type for Stem: " + arg.get_nodeValue());
+            }
+            break;
+        }
+        case Builtin::STERN:
+        {
+            CSENode arg = stack.returnLastNode();
 
-                        if (true_node.get_NodeType() == ObjectType::DELTA)
-                        {
-                            cse_machine.addNewCS(
-                                *controlStructures[stoi(true_node.get_nodeValue())]);
-                        }
-                        else
-                        {
-                            throw runtime_error("Invalid type for beta: " + true_node.get_nodeValue());
-                        }
-                    }
-                    else
-                    {
-                        CSENode false_node = cse_machine.returnLastNode();
-                        cse_machine.popLastNode();
+            if (arg.get_NodeType() == ObjectType::STRING && arg.get_IntValue() > 0)
+            {
+                // the rest keeps the tail of the buffer, so Conc may still extend it
+                stack.addNode(CSENode::slice(arg.get_StringHandle(), arg.get_ENV() + 1, arg.get_IntValue() - 1, arg.get_IsBufferTail()));
+            }
+            else
+            {
+                throw runtime_error("Invalid type for Stern: " + arg.get_nodeValue());
+            }
+            break;
+        }
+        case Builtin::Y_STAR:
+        {
+            CSENode lambda = stack.returnLastNode();
 
-                        if (false_node.get_NodeType() == ObjectType::DELTA)
-                        {
-                            cse_machine.addNewCS(
-                                *controlStructures[stoi(false_node.get_nodeValue())]);
-                        }
-                        else
-                        {
-                            throw runtime_error("Invalid type for beta: " + false_node.get_nodeValue());
-                        }
-                    }
-                }
-                else
-                {
-                    throw runtime_error("Invalid type for beta: " + node.get_nodeValue());
-                }
+            if (lambda.get_NodeType() == ObjectType::LAMBDA)
+            {
+                stack.addNode(CSENode(ObjectType::EETA, lambda.get_StringHandle(), lambda.get_CSIndex(), lambda.get_ENV()));
+            }
+            else
+            {
+                throw runtime_error("Invalid type for Y*: " + lambda.get_nodeValue());
+            }
+            break;
+        }
+        case Builtin::ITOS:
+        {
+            CSENode arg = stack.returnLastNode();
 
-                top = cse_machine.returnLastNode();
+            if (arg.get_NodeType() == ObjectType::INTEGER)
+            {
+                stack.addNode(CSENode(ObjectType::STRING, arg.get_nodeValue()));
             }
+            else
+            {
+                throw runtime_error("Invalid type for ItoS: " + arg.get_nodeValue());
+            }
+            break;
+        }
+        default:
+            // dummy and other non-functions consume nothing
+            break;
         }
+        return false;
     }
 };
 
-bool isOperator(const string &label)
-{
-    vector<string> operators_ = {"+", "-", "/", "*", "aug", "neg", "not", "eq", "gr", "ge", "ls", "le", "ne", "or", "&"};
-
-    auto it = find(operators_.begin(), operators_.end(), label);
-    return it != operators_.end();
-}
-
 #endif // CSE_H
\ No newline at end of file
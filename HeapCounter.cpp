@@ -0,0 +1,24 @@
+#include "HeapCounter.h"
+#include <cstdlib>
+#include <new>
+
+using namespace std;
+
+void *operator new(size_t size)
+{
+    if (HeapCounter::enabled)
+    {
+        HeapCounter::allocations.fetch_add(1, memory_order_relaxed);
+        HeapCounter::bytes.fetch_add(static_cast<long long>(size), memory_order_relaxed);
+    }
+    void *memory = malloc(size == 0 ? 1 : size);
+    if (memory == nullptr)
+    {
+        throw bad_alloc();
+    }
+    return memory;
+}
+
+void operator delete(void *memory) noexcept { free(memory); }
+
+void operator delete(void *memory, size_t) noexcept { free(memory); }
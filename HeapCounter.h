@@ -0,0 +1,19 @@
+#ifndef HEAPCOUNTER_H
+#define HEAPCOUNTER_H
+
+#include <atomic>
+
+using namespace std;
+
+// Heap allocations made through the global operator new, which HeapCounter.cpp replaces.
+// Counting is off until enabled, so a program linked with the counter pays one predictable
+// branch per allocation; enable it before starting threads. The counts cover every thread.
+class HeapCounter
+{
+public:
+    static inline bool enabled = false;
+    static inline atomic<long long> allocations{0};
+    static inline atomic<long long> bytes{0};
+};
+
+#endif // HEAPCOUNTER_H
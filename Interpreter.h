@@ -0,0 +1,115 @@
+#ifndef INTERPRETER_H
+#define INTERPRETER_H
+
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <string_view>
+#include "OutputSink.h"
+#include "SourceMap.h"
+
+using namespace std;
+
+class SymbolTable;
+class Tree;
+class TreeNode;
+class CSE;
+struct BytecodeProgram;
+class ProgramCache;
+class Profiler;
+
+// Phase times and machine counters of the last program an interpreter ran
+struct RunStats
+{
+    size_t sourceBytes = 0;
+    double parseMillis = 0;       // lexing runs on demand inside the parser
+    double standardizeMillis = 0; // includes resolving identifiers
+    double compileMillis = 0;
+    double evaluateMillis = 0;
+    long long createdEnvs = 0;
+    int peakEnvs = 0;
+    int liveEnvs = 0;
+    bool cacheHit = false; // the program came compiled from the cache
+
+    // gathered only when detailed statistics are on
+    double lexMillis = 0; // a separate lexing pass, since the parser lexes on demand
+    long long tokens = 0;
+    long long astNodes = 0;
+    long long stNodes = 0;
+    long long controlStructures = 0;
+    long long gammas = 0;
+    int peakStack = 0;
+    int peakControl = 0;
+    size_t treeBytes = 0; // arena bytes holding the AST and ST
+};
+
+// An RPAL interpreter.
+// It owns the symbol table, the tree and the machine state of the program it runs and shares
+// nothing with other interpreters, so separate interpreters may run on separate threads.
+// One interpreter runs one program at a time and can be reused for any number of programs.
+class Interpreter
+{
+private:
+    unique_ptr<SymbolTable> symbols;
+    unique_ptr<Tree> tree;
+    unique_ptr<CSE> cse;
+    unique_ptr<BytecodeProgram> program;
+    bool useBytecode;
+    ProgramCache *cache = nullptr;
+    bool detailedStats = false;
+    Profiler *profiler = nullptr;
+    OutputSink output; // kept across programs so its buffer is allocated once
+    SourceMap sourceMap; // lines of the loaded program, for locating run-time errors
+    RunStats runStats;
+
+    // run the loaded program into output, flushing it even when the program fails
+    void execute();
+
+    // drop the previous program
+    void reset();
+
+public:
+    explicit Interpreter(bool useBytecode = false);
+    ~Interpreter();
+
+    Interpreter(const Interpreter &) = delete;
+    Interpreter &operator=(const Interpreter &) = delete;
+
+    // run programs on the bytecode machine instead of the CSE machine
+    void setBytecode(bool enabled) { useBytecode = enabled; }
+
+    // look programs up in a compiled-program cache, and store them there after compiling;
+    // cached programs run on the bytecode machine. The cache may be shared between interpreters.
+    void setCache(ProgramCache *programCache) { cache = programCache; }
+
+    // parse a program; the AST stays valid until the next program is parsed or loaded
+    TreeNode *parse(string_view source);
+
+    // parse, standardize and compile a program, ready for execute; throws on errors
+    void load(string_view source);
+
+    // run the loaded program, writing what it prints to out; throws on run-time errors
+    void execute(ostream &out);
+
+    // run the loaded program, appending what it prints to out
+    void execute(string &out);
+
+    // load and execute a program; returns what it prints
+    string run(string_view source);
+
+    // gather the counters of RunStats that cost extra work: a separate lexing pass, tree node
+    // counts and peak machine depths
+    void setDetailedStats(bool enabled) { detailedStats = enabled; }
+
+    // sample the call stacks of programs into profile; profiled programs run on the CSE machine,
+    // bypassing the bytecode machine and the cache
+    void setProfiler(Profiler *profile) { profiler = profile; }
+
+    // version of the interpreter build, which keys the compiled-program cache
+    static const char *version();
+
+    // timing and counters of the last program
+    const RunStats &stats() const { return runStats; }
+};
+
+#endif // INTERPRETER_H
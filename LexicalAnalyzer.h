@@ -3,199 +3,332 @@
 
 #include <iostream>
 #include <string>
-#include <sstream>
-#include <unordered_set>
+#include <string_view>
+#include <deque>
 #include "Token.h"
+#include "SymbolTable.h"
 
 using namespace std;
 
-unordered_set<string> custom_keywords = {"let", "where", "within", "aug", "fn", "in"};
-unordered_set<string> custom_operators = {"and", "or", "not", "gr", "ge", "ls", "le", "eq", "ne"};
-unordered_set<string> custom_booleanValues = {"true", "false"};
-
+// Streaming lexer. Tokens are views into the input, which must outlive them;
+// only string literals containing escapes are decoded into storage owned by the lexer.
 class CustomLexer
 {
 public:
-    // Constructor
-    CustomLexer(const string &input) : input(input), currentPos(0) {}
+    // Constructor; identifiers are interned in symbols
+    CustomLexer(string_view input, SymbolTable &symbols) : input(input), currentPos(0), symbols(symbols) {}
 
-    // Get the next token
+    // Get the next token, with the offset of its first character
     Token getNextToken()
     {
-        skipWhitespace();
+        skipWhitespaceAndComments();
+
+        uint32_t offset = static_cast<uint32_t>(currentPos);
+        Token token = scanToken();
+        token.offset = offset;
+        return token;
+    }
 
+    // The input being lexed, for locating errors
+    string_view getInput() const
+    {
+        return input;
+    }
+
+private:
+    // Scan the token starting at the current position
+    Token scanToken()
+    {
         if (currentPos >= input.length())
         {
             // Check if it is the last empty line or end of input
             if (currentPos == input.length())
-                return {tokenType::END_OF_FILE, ""};
+                return {tokenType::END_OF_FILE, TokenKind::END_OF_FILE, ""};
             else
-                return {tokenType::DELIMITER, ""};
+                return {tokenType::DELIMITER, TokenKind::OTHER, ""};
         }
 
+        size_t start = currentPos;
         char currentChar = input[currentPos++];
 
         if (isalpha(currentChar))
         {
-            stringstream stringStream;
-            stringStream << currentChar;
             while (currentPos < input.length() &&
                    (isalnum(input[currentPos]) || input[currentPos] == '_'))
             {
-                stringStream << input[currentPos++];
+                currentPos++;
             }
-            string identifier = stringStream.str();
+            string_view identifier = input.substr(start, currentPos - start);
 
-            // Check if the identifier is a keyword
-            if (custom_keywords.count(identifier) > 0)
-            {
-                return {tokenType::KEYWORD, identifier};
-            }
-            else if (custom_operators.count(identifier) > 0)
+            // Check if the identifier is a keyword, a word operator or a boolean
+            const ReservedWord *word = findReservedWord(identifier);
+            if (word != nullptr)
             {
-                return {tokenType::OPERATOR, identifier};
-            }
-            else if (custom_booleanValues.count(identifier) > 0)
-            {
-                if (identifier == "true")
-                    return {tokenType::INTEGER, "1"};
-                else
-                    return {tokenType::INTEGER, "0"};
+                return {word->type, word->kind, word->value};
             }
 
-            return {tokenType::IDENTIFIER, identifier};
+            return {tokenType::IDENTIFIER, TokenKind::IDENTIFIER, identifier, symbols.intern(identifier)};
         }
         else if (isdigit(currentChar))
         {
-            stringstream stringStream;
-            stringStream << currentChar;
             while (currentPos < input.length() && isdigit(input[currentPos]))
             {
-                stringStream << input[currentPos++];
+                currentPos++;
             }
-            string number = stringStream.str();
-            return {tokenType::INTEGER, number};
+            return {tokenType::INTEGER, TokenKind::INTEGER, input.substr(start, currentPos - start)};
         }
-        else if (currentChar == '/')
+        else if (isOperatorSymbol(currentChar))
         {
-            if (currentPos < input.length() && input[currentPos] == '/')
+            if (currentChar == ',')
             {
-                // Skip single-line comment
-                while (currentPos < input.length() && input[currentPos] != '\n')
-                {
-                    currentPos++;
-                }
-                // Recursively call getNextToken to get the next valid token
-                return getNextToken();
+                return {tokenType::OPERATOR, TokenKind::COMMA, input.substr(start, 1)};
+            }
+
+            while (currentPos < input.length() && isOperatorSymbol(input[currentPos]))
+            {
+                currentPos++;
             }
-            else if (isOperatorSymbol(currentChar))
+            string_view op = input.substr(start, currentPos - start);
+            return {tokenType::OPERATOR, operatorKind(op), op};
+        }
+        else if (currentChar == '\'' || currentChar == '"')
+        {
+            return scanString(currentChar);
+        }
+        else if (currentChar == '(' || currentChar == ')')
+        {
+            return {tokenType::DELIMITER, currentChar == '(' ? TokenKind::LEFT_PAREN : TokenKind::RIGHT_PAREN, input.substr(start, 1)};
+        }
+        else
+        {
+            cerr << "Error: Unknown token encountered" << endl;
+            return {tokenType::END_OF_FILE, TokenKind::END_OF_FILE, ""};
+        }
+    }
+
+    struct ReservedWord
+    {
+        string_view word;
+        tokenType type;
+        TokenKind kind;
+        string_view value; // token value; booleans lex as 1 and 0
+    };
+
+    // Perfect hash of the reserved words: no two of them share a bucket,
+    // so classification is one probe and one comparison.
+    static size_t reservedHash(string_view word)
+    {
+        return (6 * static_cast<unsigned char>(word.front()) + 24 * static_cast<unsigned char>(word.back()) + word.size()) & 31;
+    }
+
+    static const ReservedWord *findReservedWord(string_view word)
+    {
+        static const ReservedWord empty = {"", tokenType::IDENTIFIER, TokenKind::IDENTIFIER, ""};
+        static const ReservedWord words[] = {
+            {"let", tokenType::KEYWORD, TokenKind::LET, "let"},
+            {"where", tokenType::KEYWORD, TokenKind::WHERE, "where"},
+            {"within", tokenType::KEYWORD, TokenKind::WITHIN, "within"},
+            {"aug", tokenType::KEYWORD, TokenKind::AUG, "aug"},
+            {"fn", tokenType::KEYWORD, TokenKind::FN, "fn"},
+            {"in", tokenType::KEYWORD, TokenKind::IN, "in"},
+            {"and", tokenType::OPERATOR, TokenKind::AND, "and"},
+            {"or", tokenType::OPERATOR, TokenKind::OR, "or"},
+            {"not", tokenType::OPERATOR, TokenKind::NOT, "not"},
+            {"gr", tokenType::OPERATOR, TokenKind::GR, "gr"},
+            {"ge", tokenType::OPERATOR, TokenKind::GE, "ge"},
+            {"ls", tokenType::OPERATOR, TokenKind::LS, "ls"},
+            {"le", tokenType::OPERATOR, TokenKind::LE, "le"},
+            {"eq", tokenType::OPERATOR, TokenKind::EQ, "eq"},
+            {"ne", tokenType::OPERATOR, TokenKind::NE, "ne"},
+            {"true", tokenType::INTEGER, TokenKind::INTEGER, "1"},
+            {"false", tokenType::INTEGER, TokenKind::INTEGER, "0"}};
+
+        static const struct Table
+        {
+            const ReservedWord *buckets[32];
+
+            Table()
             {
-                stringstream stringStream;
-                stringStream << currentChar;
-                while (currentPos < input.length() && isOperatorSymbol(input[currentPos]))
+                for (auto &bucket : buckets)
+                {
+                    bucket = &empty;
+                }
+                for (const auto &entry : words)
                 {
-                    stringStream << input[currentPos++];
+                    buckets[reservedHash(entry.word)] = &entry;
                 }
-                string op = stringStream.str();
-                return {tokenType::OPERATOR, op};
             }
-            else
+        } table;
+
+        const ReservedWord *entry = table.buckets[reservedHash(word)];
+        return entry->word == word ? entry : nullptr;
+    }
+
+    // Kind of a run of operator symbols
+    static TokenKind operatorKind(string_view op)
+    {
+        if (op.size() == 1)
+        {
+            switch (op[0])
             {
-                cerr << "Error: Unknown token encountered" << endl;
-                return {tokenType::END_OF_FILE, ""};
+            case '+':
+                return TokenKind::PLUS;
+            case '-':
+                return TokenKind::MINUS;
+            case '*':
+                return TokenKind::TIMES;
+            case '/':
+                return TokenKind::DIVIDE;
+            case '@':
+                return TokenKind::AT;
+            case '&':
+                return TokenKind::AMPERSAND;
+            case '|':
+                return TokenKind::BAR;
+            case '.':
+                return TokenKind::DOT;
+            case '=':
+                return TokenKind::EQUALS;
+            case '>':
+                return TokenKind::GR;
+            case '<':
+                return TokenKind::LS;
+            default:
+                return TokenKind::OTHER;
             }
         }
-        else if (isOperatorSymbol(currentChar))
+
+        if (op.size() == 2)
         {
-            stringstream stringStream;
-            stringStream << currentChar;
+            if (op == "**")
+                return TokenKind::POWER;
+            if (op == "->")
+                return TokenKind::ARROW;
+            if (op == ">=")
+                return TokenKind::GE;
+            if (op == "<=")
+                return TokenKind::LE;
+            if (op == "!=")
+                return TokenKind::NE;
+        }
+        return TokenKind::OTHER;
+    }
 
-            if (stringStream.str() == ",")
-            {
-                return {tokenType::OPERATOR, stringStream.str()};
-            }
+    // Scan a quoted string; the opening quote has been consumed
+    Token scanString(char quote)
+    {
+        size_t start = currentPos;
 
-            while (currentPos < input.length() && isOperatorSymbol(input[currentPos]))
+        while (currentPos < input.length() && input[currentPos] != quote)
+        {
+            if (input[currentPos] == '\\')
             {
-                stringStream << input[currentPos++];
+                return {tokenType::STRING, TokenKind::STRING, decodeString(start, quote)};
             }
-            string op = stringStream.str();
-            return {tokenType::OPERATOR, op};
+            currentPos++;
         }
-        else if (currentChar == '\'' || currentChar == '"')
+
+        string_view str = input.substr(start, currentPos - start);
+        if (currentPos < input.length())
         {
-            bool isSingleQuote = currentChar == '\'';
+            currentPos++; // closing quote
+        }
+        return {tokenType::STRING, TokenKind::STRING, str};
+    }
 
-            stringstream stringStream;
-            while (currentPos < input.length())
+    // Decode a string literal with escapes, starting again from its first character
+    string_view decodeString(size_t start, char quote)
+    {
+        currentPos = start;
+        string str;
+
+        while (currentPos < input.length())
+        {
+            char currentChar = input[currentPos++];
+            if (currentChar == quote)
             {
-                currentChar = input[currentPos++];
-                if (currentChar == '\'' && isSingleQuote || currentChar == '"' && !isSingleQuote)
+                break;
+            }
+            else if (currentChar == '\\')
+            {
+                currentChar = currentPos < input.length() ? input[currentPos] : '\0';
+                currentPos++;
+                switch (currentChar)
                 {
+                case 't':
+                    str += '\t';
+                    break;
+                case 'n':
+                    str += '\n';
+                    break;
+                case '\\':
+                    str += '\\';
+                    break;
+                case '\'':
+                    str += '\'';
+                    break;
+                default:
+                    str += '\\';
+                    str += currentChar;
                     break;
-                }
-                else if (currentChar == '\\')
-                {
-                    currentChar = input[currentPos++];
-                    switch (currentChar)
-                    {
-                    case 't':
-                        stringStream << '\t';
-                        break;
-                    case 'n':
-                        stringStream << '\n';
-                        break;
-                    case '\\':
-                        stringStream << '\\';
-                        break;
-                    case '\'':
-                        stringStream << '\'';
-                        break;
-                    default:
-                        stringStream << '\\' << currentChar;
-                        break;
-                    }
-                }
-                else
-                {
-                    stringStream << currentChar;
                 }
             }
-            string str = stringStream.str();
-            return {tokenType::STRING, str};
-        }
-        else if (currentChar == '(' || currentChar == ')')
-        {
-            string delimiter(1, currentChar);
-            return {tokenType::DELIMITER, delimiter};
-        }
-        else
-        {
-            cerr << "Error: Unknown token encountered" << endl;
-            return {tokenType::END_OF_FILE, ""};
+            else
+            {
+                str += currentChar;
+            }
         }
+
+        decoded.push_back(move(str));
+        return decoded.back();
     }
 
-private:
-    // Skip whitespace in input stream
-    void skipWhitespace()
+    // Skip whitespace and single-line comments in input stream
+    void skipWhitespaceAndComments()
     {
-        while (currentPos < input.length() && isspace(input[currentPos]))
+        while (currentPos < input.length())
         {
-            currentPos++;
+            if (isspace(static_cast<unsigned char>(input[currentPos])))
+            {
+                currentPos++;
+            }
+            else if (input[currentPos] == '/' && currentPos + 1 < input.length() && input[currentPos + 1] == '/')
+            {
+                while (currentPos < input.length() && input[currentPos] != '\n')
+                {
+                    currentPos++;
+                }
+            }
+            else
+            {
+                break;
+            }
         }
     }
 
     // Return whether a character is an operator symbol
-    bool isOperatorSymbol(char c)
+    static bool isOperatorSymbol(char c)
     {
-        static const string operators = "+-*<>&.@/:=~|$!#%^_[}{?,";
-        return operators.find(c) != string::npos;
+        static const struct Table
+        {
+            bool symbols[256] = {};
+
+            Table()
+            {
+                for (unsigned char c : string_view("+-*<>&.@/:=~|$!#%^_[}{?,"))
+                {
+                    symbols[c] = true;
+                }
+            }
+        } table;
+        return table.symbols[static_cast<unsigned char>(c)];
     }
 
 private:
-    string input;
+    string_view input;
     size_t currentPos;
+    SymbolTable &symbols;
+    deque<string> decoded; // decoded string literals; deque keeps their addresses stable
 };
 
 #endif // CUSTOMLEXER_H
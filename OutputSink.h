@@ -0,0 +1,89 @@
+#ifndef OUTPUTSINK_H
+#define OUTPUTSINK_H
+
+#include <charconv>
+#include <iostream>
+#include <string>
+#include <string_view>
+
+using namespace std;
+
+// Destination of what a program prints.
+// Writes collect in one buffer that is handed to the stream in large blocks, only when it fills
+// or at an explicit flush, instead of one stream call per printed piece. A sink aimed at a string
+// appends straight to it. The buffer keeps its capacity, so a sink reused across programs
+// allocates it once.
+class OutputSink
+{
+private:
+    static constexpr size_t CAPACITY = 1 << 16;
+
+    string buffer;
+    ostream *stream = &cout;
+    string *text = nullptr; // when set, writes append here and stream is unused
+
+    string &pending() { return text != nullptr ? *text : buffer; }
+
+    void spill()
+    {
+        if (text == nullptr && buffer.size() >= CAPACITY)
+        {
+            flush();
+        }
+    }
+
+public:
+    OutputSink() = default;
+
+    OutputSink(const OutputSink &) = delete;
+    OutputSink &operator=(const OutputSink &) = delete;
+
+    // aim the sink at a stream; anything still buffered goes to the previous target first
+    void setTarget(ostream &target)
+    {
+        flush();
+        stream = &target;
+        text = nullptr;
+        buffer.reserve(CAPACITY);
+    }
+
+    // aim the sink at a string, which then receives every write directly
+    void setTarget(string &target)
+    {
+        flush();
+        text = &target;
+    }
+
+    void write(string_view value)
+    {
+        pending().append(value);
+        spill();
+    }
+
+    void write(char value)
+    {
+        pending().push_back(value);
+        spill();
+    }
+
+    // decimal form of an integer, without a temporary string
+    void writeInteger(long long value)
+    {
+        char digits[24];
+        to_chars_result result = to_chars(digits, digits + sizeof(digits), value);
+        write(string_view(digits, result.ptr - digits));
+    }
+
+    // hand everything buffered to the stream and flush it
+    void flush()
+    {
+        if (text == nullptr && !buffer.empty())
+        {
+            stream->write(buffer.data(), buffer.size());
+            stream->flush();
+            buffer.clear();
+        }
+    }
+};
+
+#endif // OUTPUTSINK_H
@@ -2,741 +2,545 @@
 #define RPAL_PARSER_H
 
 #include <vector>
+#include <stdexcept>
 #include "Token.h"
 #include "LexicalAnalyzer.h"
-#include "TokenController.h"
+#include "SymbolTable.h"
+#include "SourceMap.h"
 #include "Tree.h"
-#include "TreeNode.h"
 using namespace std;
 
-void E();
-void Ew();
-void T();
-void Ta();
-void Tc();
-void B();
-void Bt();
-void Bs();
-void Bp();
-void A();
-void At();
-void Af();
-void Ap();
-void R();
-void Rn();
-void D();
-void Da();
-void Dr();
-void Db();
-void Vb();
-void Vl();
-
-// parser
+// Recursive-descent parser for RPAL.
+// Each production switches on the kind of the current token and returns the node it built,
+// with its children added in source order. Each node records the offset of the construct it
+// came from: a leaf its token, a let or fn its keyword, and any other node its first child.
+// All state lives in the parser object, so separate parsers may run at the same time on
+// separate lexers and trees.
+// let and fn prefixes and chains of conditionals are parsed in loops, so long chains of them
+// do not deepen the native stack.
 class Parser
 {
-public:
-    static vector<TreeNode *> NodeOfStack;
+private:
+    CustomLexer &lexer;
+    Tree &tree;    // Owns the nodes
+    Token current; // Next token to be consumed
 
-    static void parse()
+public:
+    Parser(CustomLexer &lexer, Tree &tree) : lexer(lexer), tree(tree)
     {
-        TokenController &tokenController = TokenController::getInstance();
-        Token token = tokenController.top();
+        current = lexer.getNextToken();
+    }
 
+    // Parse the whole program; returns its AST, or nullptr for an empty program
+    TreeNode *parse()
+    {
         // if input token equals end of file token
-        if (token.type == tokenType::END_OF_FILE)
+        if (current.kind == TokenKind::END_OF_FILE)
         {
-            return;
+            return nullptr;
         }
-        else
-        {
-            E(); // initialize with E()
 
-            // if next token is end of file token
-            if (tokenController.top().type == tokenType::END_OF_FILE)
-            {
-                // set root of ast to last node in NodeOfStack
-                Tree::getInstance().setASTRoot(Parser::NodeOfStack.back());
-                return;
-            }
-            else
-            {
-                throw runtime_error("Syntax Error: end of file expected");
-            }
+        TreeNode *root = E();
+
+        // if next token is end of file token
+        if (current.kind != TokenKind::END_OF_FILE)
+        {
+            throw syntaxError("Syntax Error: end of file expected");
         }
+        return root;
     }
-};
-
-vector<TreeNode *> Parser::NodeOfStack;
 
-void build_tree(const string &label, const int &num, const bool isLeaf, const string &value = "")
-{
-    TreeNode *node;
-
-    if (isLeaf)
+private:
+    // Consume the current token and lex the next one
+    Token pop()
     {
-        node = new LeafNode(label, value);
+        Token token = current;
+        if (current.kind != TokenKind::END_OF_FILE)
+        {
+            current = lexer.getNextToken();
+        }
+        return token;
     }
-    else
+
+    // Syntax error at the current token
+    runtime_error syntaxError(const string &message) const
     {
-        node = new InternalNode(label);
+        return runtime_error(message + " at " + SourceMap::describe(lexer.getInput(), current.offset));
     }
-    for (int i = 0; i < num; i++)
+
+    // Consume a token of the given kind or fail with message
+    void expect(TokenKind kind, const char *message)
     {
-        node->addChild(Parser::NodeOfStack.back());
-        Parser::NodeOfStack.pop_back();
+        if (current.kind != kind)
+        {
+            throw syntaxError(message);
+        }
+        pop();
     }
-    node->reverseChildren();
 
-    Parser::NodeOfStack.push_back(node);
-}
+    TreeNode *node(NodeKind kind, TreeNode *first)
+    {
+        TreeNode *result = tree.internalNode(kind, first->getOffset());
+        result->addChild(first);
+        return result;
+    }
 
-// Parses the expression (E).
-// This function is the entry point for parsing expressions.
-void E()
-{
-    TokenController &tokenController = TokenController::getInstance();
+    TreeNode *node(NodeKind kind, TreeNode *first, TreeNode *second)
+    {
+        TreeNode *result = node(kind, first);
+        result->addChild(second);
+        return result;
+    }
 
-    // If the current token is "let"
-    if (tokenController.top().value == "let")
+    // Identifier leaf for the current token
+    TreeNode *identifier()
     {
-        tokenController.pop();
-        D(); // Parse declaration
-        // If the next token is "in"
-        if (tokenController.top().value == "in")
+        if (current.kind != TokenKind::IDENTIFIER)
         {
-            tokenController.pop();
-            E(); // Parse nested expression
+            throw syntaxError("Syntax Error: Identifier expected");
         }
-        else
-        {
-            throw runtime_error("Syntax Error: 'in' expected");
-        }
-        // Construct a "let" node with 2 children
-        build_tree("let", 2, false);
+        Token token = pop();
+        return tree.identifierNode(token.symbol, token.offset);
     }
-    // If the current token is "fn"
-    else if (tokenController.top().value == "fn")
+
+    // Tokens that can start an Rn
+    static bool startsRand(TokenKind kind)
     {
-        tokenController.pop();
-        int n = 0;
+        return kind == TokenKind::IDENTIFIER || kind == TokenKind::INTEGER || kind == TokenKind::STRING ||
+               kind == TokenKind::LEFT_PAREN;
+    }
 
-        // Process identifiers until a non-identifier token is encountered
-        while (tokenController.top().type == tokenType::IDENTIFIER)
-        {
-            Vb(); // Parse variable binding
-            n++;
-        }
+    // E -> 'let' D 'in' E | 'fn' Vb+ '.' E | Ew
+    TreeNode *E()
+    {
+        // let and fn nodes still waiting for their body
+        vector<TreeNode *> open;
 
-        if (n == 0)
+        while (current.kind == TokenKind::LET || current.kind == TokenKind::FN)
         {
-            throw runtime_error("Syntax Error: at least one identifier expected");
+            Token keyword = pop();
+            if (keyword.kind == TokenKind::LET)
+            {
+                TreeNode *let = tree.internalNode(NodeKind::LET, keyword.offset);
+                let->addChild(D());
+                open.push_back(let);
+                expect(TokenKind::IN, "Syntax Error: 'in' expected");
+            }
+            else
+            {
+                TreeNode *lambda = tree.internalNode(NodeKind::LAMBDA, keyword.offset);
+
+                while (current.kind == TokenKind::IDENTIFIER || current.kind == TokenKind::LEFT_PAREN)
+                {
+                    lambda->addChild(Vb());
+                }
+                if (lambda->getNumChildren() == 0)
+                {
+                    throw syntaxError("Syntax Error: at least one identifier expected");
+                }
+
+                expect(TokenKind::DOT, "Syntax Error: '.' expected");
+                open.push_back(lambda);
+            }
         }
 
-        // If the next token is "."
-        if (tokenController.top().value == ".")
+        TreeNode *body = Ew();
+        while (!open.empty())
         {
-            tokenController.pop();
-            E(); // Parse nested expression
+            open.back()->addChild(body);
+            body = open.back();
+            open.pop_back();
         }
-        else
-        {
-            throw runtime_error("Syntax Error: '.' expected");
-        }
-
-        // Construct a "lambda" node with n+1 children
-        build_tree("lambda", n + 1, false);
+        return body;
     }
-    else
+
+    // Ew -> T 'where' Dr | T
+    TreeNode *Ew()
     {
-        Ew(); // Parse Ew (Expression with "where" clause)
-    }
-}
+        TreeNode *term = T();
 
-// Parses the expression with a "where" clause (Ew).
-// This function handles expressions followed by a "where" clause.
-void Ew()
-{
-    TokenController &tokenController = TokenController::getInstance();
-    T(); // Parse term
+        if (current.kind == TokenKind::WHERE)
+        {
+            pop();
+            return node(NodeKind::WHERE, term, Dr());
+        }
+        return term;
+    }
 
-    // If the next token is "where"
-    if (tokenController.top().value == "where")
+    // T -> Ta (',' Ta)+ | Ta
+    TreeNode *T()
     {
-        tokenController.pop();
-        Dr();                          // Parse declaration list
-        build_tree("where", 2, false); // Construct a "where" node with 2 children
-    }
-}
+        TreeNode *first = Ta();
 
-// Parses a term (T).
-// This function handles parsing terms and their combination with commas.
-void T()
-{
-    TokenController &tokenController = TokenController::getInstance();
-    Ta(); // Parse atomic term
-    int n = 0;
+        if (current.kind != TokenKind::COMMA)
+        {
+            return first;
+        }
 
-    // Process additional atomic terms separated by commas
-    while (tokenController.top().value == ",")
-    {
-        tokenController.pop();
-        Ta(); // Parse atomic term
-        n++;
+        TreeNode *tau = node(NodeKind::TAU, first);
+        while (current.kind == TokenKind::COMMA)
+        {
+            pop();
+            tau->addChild(Ta());
+        }
+        return tau;
     }
 
-    if (n > 0)
+    // Ta -> Ta 'aug' Tc | Tc
+    TreeNode *Ta()
     {
-        build_tree("tau", n + 1, false); // Construct a "tau" node with n+1 children
-    }
-}
+        TreeNode *left = Tc();
 
-// Parses an atomic term (Ta).
-// This function handles parsing atomic terms and their combination with "aug" clauses.
-void Ta()
-{
-    TokenController &tokenController = TokenController::getInstance();
-    Tc(); // Parse term construction
-    // Process additional term constructions separated by "aug" clauses
-    while (tokenController.top().value == "aug")
-    {
-        tokenController.pop();
-        Tc();                        // Parse term construction
-        build_tree("aug", 2, false); // Construct an "aug" node with 2 children
+        while (current.kind == TokenKind::AUG)
+        {
+            pop();
+            left = node(NodeKind::AUG, left, Tc());
+        }
+        return left;
     }
-}
 
-// Parses a term construction (Tc).
-// This function handles parsing term constructions and their combination with "->" and "|" clauses.
-void Tc()
-{
-    TokenController &tokenController = TokenController::getInstance();
-    B(); // Parse boolean expression
-
-    // If the next token is "->"
-    if (tokenController.top().value == "->")
+    // Tc -> B '->' Tc '|' Tc | B
+    TreeNode *Tc()
     {
-        tokenController.pop();
-        Tc(); // Parse nested term construction
+        // conditionals still waiting for their else branch; an else branch that is itself a
+        // conditional continues the loop instead of recursing
+        vector<TreeNode *> open;
+        TreeNode *expr = B();
 
-        // If the next token is "|"
-        if (tokenController.top().value == "|")
+        while (current.kind == TokenKind::ARROW)
         {
-            tokenController.pop();
-            Tc();                       // Parse nested term construction
-            build_tree("->", 3, false); // Construct a "->" node with 3 children
+            pop();
+            TreeNode *conditional = node(NodeKind::CONDITIONAL, expr, Tc());
+            expect(TokenKind::BAR, "Syntax Error: '|' expected");
+            open.push_back(conditional);
+            expr = B();
         }
-        else
+
+        while (!open.empty())
         {
-            throw runtime_error("Syntax Error: '|' expected");
+            open.back()->addChild(expr);
+            expr = open.back();
+            open.pop_back();
         }
+        return expr;
     }
-}
 
-// Parses a boolean expression (B).
-// This function handles parsing boolean expressions and their combination with "or" clauses.
-void B()
-{
-    TokenController &tokenController = TokenController::getInstance();
-    Bt(); // Parse boolean term
-
-    // Process additional boolean terms separated by "or" clauses
-    while (tokenController.top().value == "or")
+    // B -> B 'or' Bt | Bt
+    TreeNode *B()
     {
-        tokenController.pop();
-        Bt();                       // Parse boolean term
-        build_tree("or", 2, false); // Construct an "or" node with 2 children
-    }
-}
+        TreeNode *left = Bt();
 
-// Parses a boolean term (Bt).
-// This function handles parsing boolean terms and their combination with "&" clauses.
-void Bt()
-{
-    TokenController &tokenController = TokenController::getInstance();
-    Bs(); // Parse boolean factor
-
-    // Process additional boolean factors separated by "&" clauses
-    while (tokenController.top().value == "&")
-    {
-        tokenController.pop();
-        Bs();                      // Parse boolean factor
-        build_tree("&", 2, false); // Construct an "&" node with 2 children
+        while (current.kind == TokenKind::OR)
+        {
+            pop();
+            left = node(NodeKind::OR, left, Bt());
+        }
+        return left;
     }
-}
 
-// Parses a boolean factor (Bs).
-// This function handles parsing boolean factors and negations.
-void Bs()
-{
-    TokenController &tokenController = TokenController::getInstance();
-    if (tokenController.top().value == "not")
-    {
-        tokenController.pop();
-        Bp();                        // Parse boolean primary
-        build_tree("not", 1, false); // Construct a "not" node with 1 child
-    }
-    else
+    // Bt -> Bt '&' Bs | Bs
+    TreeNode *Bt()
     {
-        Bp(); // Parse boolean primary
-    }
-}
-
-// Parses a boolean primary (Bp).
-// This function handles parsing boolean primaries and their comparison operations.
-void Bp()
-{
-    TokenController &tokenController = TokenController::getInstance();
-    A(); // Parse arithmetic expression
+        TreeNode *left = Bs();
 
-    // Check for comparison operators
-    if (tokenController.top().value == "gr" || tokenController.top().value == ">")
-    {
-        tokenController.pop();
-        A();                        // Parse another arithmetic expression
-        build_tree("gr", 2, false); // Construct a "gr" node with 2 children
-    }
-    else if (tokenController.top().value == "ge" || tokenController.top().value == ">=")
-    {
-        tokenController.pop();
-        A();                        // Parse another arithmetic expression
-        build_tree("ge", 2, false); // Construct a "ge" node with 2 children
-    }
-    else if (tokenController.top().value == "ls" || tokenController.top().value == "<")
-    {
-        tokenController.pop();
-        A();                        // Parse another arithmetic expression
-        build_tree("ls", 2, false); // Construct a "ls" node with 2 children
-    }
-    else if (tokenController.top().value == "le" || tokenController.top().value == "<=")
-    {
-        tokenController.pop();
-        A();                        // Parse another arithmetic expression
-        build_tree("le", 2, false); // Construct a "le" node with 2 children
+        while (current.kind == TokenKind::AMPERSAND)
+        {
+            pop();
+            left = node(NodeKind::AMPERSAND, left, Bs());
+        }
+        return left;
     }
-    else if (tokenController.top().value == "eq" || tokenController.top().value == "=")
+
+    // Bs -> 'not' Bp | Bp
+    TreeNode *Bs()
     {
-        tokenController.pop();
-        A();                        // Parse another arithmetic expression
-        build_tree("eq", 2, false); // Construct an "eq" node with 2 children
+        if (current.kind == TokenKind::NOT)
+        {
+            pop();
+            return node(NodeKind::NOT, Bp());
+        }
+        return Bp();
     }
-    else if (tokenController.top().value == "ne" || tokenController.top().value == "!=")
+
+    // Bp -> A ('gr' | 'ge' | 'ls' | 'le' | 'eq' | 'ne') A | A
+    TreeNode *Bp()
     {
-        tokenController.pop();
-        A();                        // Parse another arithmetic expression
-        build_tree("ne", 2, false); // Construct a "ne" node with 2 children
-    }
-}
+        TreeNode *left = A();
+        NodeKind kind;
 
-// Parses an arithmetic expression (A).
-// This function handles parsing arithmetic expressions and their combination with addition and subtraction operators.
-void A()
-{
-    TokenController &tokenController = TokenController::getInstance();
+        switch (current.kind)
+        {
+        case TokenKind::GR:
+            kind = NodeKind::GR;
+            break;
+        case TokenKind::GE:
+            kind = NodeKind::GE;
+            break;
+        case TokenKind::LS:
+            kind = NodeKind::LS;
+            break;
+        case TokenKind::LE:
+            kind = NodeKind::LE;
+            break;
+        case TokenKind::EQ:
+            kind = NodeKind::EQ;
+            break;
+        case TokenKind::NE:
+            kind = NodeKind::NE;
+            break;
+        default:
+            return left;
+        }
 
-    // Check for unary plus operator
-    if (tokenController.top().value == "+")
-    {
-        tokenController.pop();
-        At(); // Parse term
-    }
-    // Check for unary minus operator
-    else if (tokenController.top().value == "-")
-    {
-        tokenController.pop();
-        At();                        // Parse term
-        build_tree("neg", 1, false); // Construct a "neg" node with 1 child
-    }
-    else
-    {
-        At(); // Parse term
+        pop();
+        return node(kind, left, A());
     }
 
-    // Process addition and subtraction operators
-    while (tokenController.top().value == "+" || tokenController.top().value == "-")
+    // A -> A ('+' | '-') At | ('+' | '-') At | At
+    TreeNode *A()
     {
-        if (tokenController.top().value == "+")
+        TreeNode *left;
+
+        if (current.kind == TokenKind::PLUS)
         {
-            tokenController.pop();
-            At();                      // Parse term
-            build_tree("+", 2, false); // Construct a "+" node with 2 children
+            pop();
+            left = At();
         }
-        else if (tokenController.top().value == "-")
+        else if (current.kind == TokenKind::MINUS)
         {
-            tokenController.pop();
-            At();                      // Parse term
-            build_tree("-", 2, false); // Construct a "-" node with 2 children
+            pop();
+            left = node(NodeKind::NEG, At());
         }
-    }
-}
-
-// Parses a term (At).
-// This function handles parsing terms and their combination with multiplication and division operators.
-void At()
-{
-    TokenController &tokenController = TokenController::getInstance();
-    Af(); // Parse atomic formula
-
-    // Process multiplication and division operators
-    while (tokenController.top().value == "*" || tokenController.top().value == "/")
-    {
-        if (tokenController.top().value == "*")
+        else
         {
-            tokenController.pop();
-            Af();                      // Parse atomic formula
-            build_tree("*", 2, false); // Construct a "*" node with 2 children
+            left = At();
         }
-        else if (tokenController.top().value == "/")
+
+        while (current.kind == TokenKind::PLUS || current.kind == TokenKind::MINUS)
         {
-            tokenController.pop();
-            Af();                      // Parse atomic formula
-            build_tree("/", 2, false); // Construct a "/" node with 2 children
+            NodeKind kind = pop().kind == TokenKind::PLUS ? NodeKind::PLUS : NodeKind::MINUS;
+            left = node(kind, left, At());
         }
+        return left;
     }
-}
-
-// Parses an atomic formula (Af).
-// This function handles parsing atomic formulas and their combination with exponentiation operators.
-void Af()
-{
-    TokenController &tokenController = TokenController::getInstance();
-    Ap(); // Parse application
 
-    // Process exponentiation operator
-    while (tokenController.top().value == "**")
+    // At -> At ('*' | '/') Af | Af
+    TreeNode *At()
     {
-        tokenController.pop();
-        Ap();                       // Parse application
-        build_tree("**", 2, false); // Construct a "**" node with 2 children
-    }
-}
+        TreeNode *left = Af();
 
-// Parses an application (Ap).
-// This function handles parsing function applications.
-void Ap()
-{
-    TokenController &tokenController = TokenController::getInstance();
-    R(); // Parse basic expression
+        while (current.kind == TokenKind::TIMES || current.kind == TokenKind::DIVIDE)
+        {
+            NodeKind kind = pop().kind == TokenKind::TIMES ? NodeKind::MULTIPLY : NodeKind::DIVIDE;
+            left = node(kind, left, Af());
+        }
+        return left;
+    }
 
-    // Process function application operator
-    while (tokenController.top().value == "@")
+    // Af -> Ap '**' Af | Ap, grouped to the left as before
+    TreeNode *Af()
     {
-        tokenController.pop();
+        TreeNode *left = Ap();
 
-        // If the next token is an identifier
-        if (tokenController.top().type == tokenType::IDENTIFIER)
-        {
-            Token token = tokenController.pop();
-            build_tree("identifier", 0, true, token.value); // Construct an identifier node
-        }
-        else
+        while (current.kind == TokenKind::POWER)
         {
-            throw runtime_error("Syntax Error: Identifier expected");
+            pop();
+            left = node(NodeKind::POWER, left, Ap());
         }
-
-        R();                       // Parse basic expression
-        build_tree("@", 3, false); // Construct an "@" node with 3 children
+        return left;
     }
-}
-
-// Parses a basic expression (R).
-// This function handles parsing basic expressions and their combinations.
-void R()
-{
-    TokenController &tokenController = TokenController::getInstance();
-    Rn(); // Parse basic factor
 
-    Token top = tokenController.top();
-    while (top.type == tokenType::IDENTIFIER || top.type == tokenType::INTEGER || top.type == tokenType::STRING || top.value == "true" || top.value == "false" || top.value == "nil" || top.value == "(" || top.value == "dummy")
+    // Ap -> Ap '@' <IDENTIFIER> R | R
+    TreeNode *Ap()
     {
-        Rn(); // Parse basic factor
-        top = tokenController.top();
-        build_tree("gamma", 2, false); // Construct a "gamma" node with 2 children
-    }
-}
+        TreeNode *left = R();
 
-// Parses a basic factor (Rn).
-// This function handles parsing basic factors such as identifiers, integers, strings, etc.
-void Rn()
-{
-    TokenController &tokenController = TokenController::getInstance();
-    Token top = tokenController.top();
-
-    if (top.type == tokenType::IDENTIFIER)
-    {
-        // Parse identifier
-        Token token = tokenController.pop();
-        build_tree("identifier", 0, true, token.value); // Construct an identifier node
-    }
-    else if (top.type == tokenType::INTEGER)
-    {
-        // Parse integer
-        Token token = tokenController.pop();
-        build_tree("integer", 0, true, token.value); // Construct an integer node
-    }
-    else if (top.type == tokenType::STRING)
-    {
-        // Parse string
-        Token token = tokenController.pop();
-        build_tree("string", 0, true, token.value); // Construct a string node
-    }
-    else if (top.value == "true")
-    {
-        // Parse true
-        tokenController.pop();
-        build_tree("true", 0, true); // Construct a "true" node
-    }
-    else if (top.value == "false")
-    {
-        // Parse false
-        tokenController.pop();
-        build_tree("false", 0, true); // Construct a "false" node
+        while (current.kind == TokenKind::AT)
+        {
+            pop();
+            TreeNode *at = node(NodeKind::AT, left, identifier());
+            at->addChild(R());
+            left = at;
+        }
+        return left;
     }
-    else if (top.value == "nil")
+
+    // R -> R Rn | Rn
+    TreeNode *R()
     {
-        // Parse nil
-        tokenController.pop();
-        build_tree("nil", 0, true); // Construct a "nil" node
+        TreeNode *left = Rn();
+
+        while (startsRand(current.kind))
+        {
+            left = node(NodeKind::GAMMA, left, Rn());
+        }
+        return left;
     }
-    else if (top.value == "(")
-    {
-        tokenController.pop();
-        E(); // Parse expression
 
-        if (tokenController.top().value == ")")
+    // Rn -> <IDENTIFIER> | <INTEGER> | <STRING> | '(' E ')'
+    // true and false lex as integers; nil and dummy are predefined identifiers
+    TreeNode *Rn()
+    {
+        switch (current.kind)
+        {
+        case TokenKind::IDENTIFIER:
+            return identifier();
+        case TokenKind::INTEGER:
+        case TokenKind::STRING:
         {
-            tokenController.pop();
+            Token token = pop();
+            return tree.leafNode(token.kind == TokenKind::INTEGER ? NodeKind::INTEGER : NodeKind::STRING, token.value, token.offset);
         }
-        else
+        case TokenKind::LEFT_PAREN:
         {
-            throw runtime_error("Syntax Error: ')' expected");
+            pop();
+            TreeNode *expr = E();
+            expect(TokenKind::RIGHT_PAREN, "Syntax Error: ')' expected");
+            return expr;
+        }
+        default:
+            throw syntaxError("Syntax Error: Identifier, Integer, String, 'true', 'false', 'nil', '(', 'dummy' expected\ngot: " + string(current.value));
         }
     }
-    else if (top.value == "dummy")
-    {
-        // Parse dummy
-        tokenController.pop();
-        build_tree("dummy", 0, true); // Construct a "dummy" node
-    }
-    else
-    {
-        throw runtime_error("Syntax Error: Identifier, Integer, String, 'true', 'false', 'nil', '(', 'dummy' expected\ngot: " + top.value);
-    }
-}
-
-// Parses a declaration (D).
-// This function handles parsing declarations.
-void D()
-{
-    TokenController &tokenController = TokenController::getInstance();
-    Da(); // Parse declaration(s) followed by "within"
 
-    while (tokenController.top().value == "within")
+    // D -> Da 'within' D | Da
+    TreeNode *D()
     {
-        tokenController.pop();
-        D();                            // Parse declaration(s)
-        build_tree("within", 2, false); // Construct a "within" node with 2 children
-    }
-}
+        TreeNode *left = Da();
 
-// Parses a declaration (Da).
-// This function handles parsing declaration(s) followed by "and".
-void Da()
-{
-    TokenController &tokenController = TokenController::getInstance();
-    Dr(); // Parse recursive declaration(s)
-    int n = 0;
-
-    while (tokenController.top().value == "and")
-    {
-        tokenController.pop();
-        Dr(); // Parse recursive declaration(s)
-        n++;
-    }
-    if (n > 0)
-    {
-        build_tree("and", n + 1, false); // Construct an "and" node with n+1 children
+        while (current.kind == TokenKind::WITHIN)
+        {
+            pop();
+            left = node(NodeKind::WITHIN, left, D());
+        }
+        return left;
     }
-}
 
-// Parses a recursive declaration (Dr).
-// This function handles parsing recursive declaration(s) preceded by "rec".
-void Dr()
-{
-    TokenController &tokenController = TokenController::getInstance();
-
-    if (tokenController.top().value == "rec")
-    {
-        tokenController.pop();
-        Db();                        // Parse basic declaration
-        build_tree("rec", 1, false); // Construct a "rec" node with 1 child
-    }
-    else
+    // Da -> Dr ('and' Dr)+ | Dr
+    TreeNode *Da()
     {
-        Db(); // Parse basic declaration
-    }
-}
-
-// Parses a basic declaration (Db).
-// This function handles parsing basic declaration(s) defined by identifiers and expressions.
-void Db()
-{
-    TokenController &tokenController = TokenController::getInstance();
+        TreeNode *first = Dr();
 
-    if (tokenController.top().value == "(")
-    {
-        tokenController.pop();
-        D(); // Parse declaration
-        if (tokenController.top().value == ")")
+        if (current.kind != TokenKind::AND)
         {
-            tokenController.pop();
+            return first;
         }
-        else
+
+        TreeNode *simultaneous = node(NodeKind::AND, first);
+        while (current.kind == TokenKind::AND)
         {
-            throw runtime_error("Syntax Error: ')' expected");
+            pop();
+            simultaneous->addChild(Dr());
         }
+        return simultaneous;
     }
-    else if (tokenController.top().type == tokenType::IDENTIFIER)
-    {
-        // Parse identifier
-        Token token = tokenController.pop();
-        build_tree("identifier", 0, true, token.value);
 
-        if (tokenController.top().value == ",")
+    // Dr -> 'rec' Db | Db
+    TreeNode *Dr()
+    {
+        if (current.kind == TokenKind::IDENTIFIER && current.symbol == SymbolTable::REC_WORD)
         {
-            tokenController.pop();
-            Vl(); // Parse variable list
+            pop();
+            return node(NodeKind::REC, Db());
+        }
+        return Db();
+    }
 
-            if (tokenController.top().value == "=")
-            {
-                tokenController.pop();
-                E();                       // Parse expression
-                build_tree("=", 2, false); // Construct an "=" node with 2 children
-            }
-            else
-            {
-                throw runtime_error("Syntax Error: '=' expected");
-            }
+    // Db -> Vl '=' E | <IDENTIFIER> Vb+ '=' E | '(' D ')'
+    TreeNode *Db()
+    {
+        if (current.kind == TokenKind::LEFT_PAREN)
+        {
+            pop();
+            TreeNode *definition = D();
+            expect(TokenKind::RIGHT_PAREN, "Syntax Error: ')' expected");
+            return definition;
         }
-        else
+
+        if (current.kind != TokenKind::IDENTIFIER)
         {
-            int n = 0;
+            throw syntaxError("Syntax Error: '(' or Identifier expected");
+        }
 
-            while (tokenController.top().value != "=" && tokenController.top().type == tokenType::IDENTIFIER)
-            {
-                Vb(); // Parse variable bound
-                n++;
-            }
+        TreeNode *name = identifier();
 
-            if (tokenController.top().value == "(")
-            {
-                Vb(); // Parse variable bound
-                n++;
-            }
+        if (current.kind == TokenKind::COMMA)
+        {
+            pop();
+            TreeNode *vars = Vl(name);
+            expect(TokenKind::EQUALS, "Syntax Error: '=' expected");
+            return node(NodeKind::EQUALS, vars, E());
+        }
 
-            if (n == 0 && tokenController.top().value == "=")
-            {
-                tokenController.pop();
-                E();                       // Parse expression
-                build_tree("=", 2, false); // Construct an "=" node with 2 children
-            }
-            else if (n != 0 && tokenController.top().value == "=")
-            {
-                tokenController.pop();
-                E();                                  // Parse expression
-                build_tree("fcn_form", n + 2, false); // Construct a "fcn_form" node with n+2 children
-            }
-            else
-            {
-                throw runtime_error("Syntax Error: '=' expected");
-            }
+        if (current.kind == TokenKind::EQUALS)
+        {
+            pop();
+            return node(NodeKind::EQUALS, name, E());
         }
-    }
-    else
-    {
-        throw runtime_error("Syntax Error: '(' or Identifier expected");
-    }
-}
 
-// Parses a variable bound (Vb).
-// This function handles parsing variable bounds, which can be identifiers or parenthesized expressions.
-void Vb()
-{
-    TokenController &tokenController = TokenController::getInstance();
+        TreeNode *function = node(NodeKind::FCN_FORM, name);
+        while (current.kind == TokenKind::IDENTIFIER || current.kind == TokenKind::LEFT_PAREN)
+        {
+            function->addChild(Vb());
+        }
+        if (function->getNumChildren() == 1)
+        {
+            throw syntaxError("Syntax Error: '=' expected");
+        }
 
-    if (tokenController.top().type == tokenType::IDENTIFIER)
-    {
-        // Parse identifier
-        Token token = tokenController.pop();
-        build_tree("identifier", 0, true, token.value); // Construct an identifier node
+        expect(TokenKind::EQUALS, "Syntax Error: '=' expected");
+        function->addChild(E());
+        return function;
     }
-    else if (tokenController.top().value == "(")
-    {
-        tokenController.pop();
 
-        if (tokenController.top().value == ")")
+    // Vb -> <IDENTIFIER> | '(' Vl ')' | '(' ')'
+    TreeNode *Vb()
+    {
+        if (current.kind == TokenKind::IDENTIFIER)
         {
-            tokenController.pop();
-            build_tree("()", 0, true); // Construct an "()" node
+            return identifier();
         }
-        else if (tokenController.top().type == tokenType::IDENTIFIER)
+
+        if (current.kind != TokenKind::LEFT_PAREN)
         {
-            // Parse identifier
-            Token token = tokenController.pop();
-            build_tree("identifier", 0, true, token.value); // Construct an identifier node
+            throw syntaxError("Syntax Error: Identifier or '(' expected");
+        }
+        pop();
 
-            if (tokenController.top().value == ",")
-            {
-                tokenController.pop();
-                Vl(); // Parse variable list
-            }
+        if (current.kind == TokenKind::RIGHT_PAREN)
+        {
+            pop();
+            return tree.leafNode(NodeKind::EMPTY_PARAMS, "");
+        }
 
-            if (tokenController.top().value == ")")
-            {
-                tokenController.pop();
-            }
-            else
-            {
-                throw runtime_error("Syntax Error: ')' expected");
-            }
+        if (current.kind != TokenKind::IDENTIFIER)
+        {
+            throw syntaxError("Syntax Error: Identifier or ')' expected");
         }
-        else
+
+        TreeNode *vars = identifier();
+        if (current.kind == TokenKind::COMMA)
         {
-            throw runtime_error("Syntax Error: Identifier or ')' expected");
+            pop();
+            vars = Vl(vars);
         }
-    }
-    else
-    {
-        throw runtime_error("Syntax Error: Identifier or '(' expected");
-    }
-}
 
-// Parses a variable list (Vl).
-// This function handles parsing comma-separated lists of identifiers.
-void Vl()
-{
-    TokenController &tokenController = TokenController::getInstance();
+        expect(TokenKind::RIGHT_PAREN, "Syntax Error: ')' expected");
+        return vars;
+    }
 
-    if (tokenController.top().type == tokenType::IDENTIFIER)
+    // Vl -> <IDENTIFIER> (',' <IDENTIFIER>)*, after its first identifier and comma
+    TreeNode *Vl(TreeNode *first)
     {
-        // Parse identifier
-        Token token = tokenController.pop();
-        build_tree("identifier", 0, true, token.value); // Construct an identifier node
+        TreeNode *comma = node(NodeKind::COMMA, first, identifier());
 
-        int n = 2;
-        while (tokenController.top().value == ",")
+        while (current.kind == TokenKind::COMMA)
         {
-            tokenController.pop();
-            token = tokenController.pop();
-            build_tree("identifier", 0, true, token.value); // Construct an identifier node
-            n++;
+            pop();
+            comma->addChild(identifier());
         }
-
-        build_tree(",", n, false); // Construct a "," node with n children
+        return comma;
     }
-    else
-    {
-        throw runtime_error("Syntax Error: Identifier expected");
-    }
-}
+};
 
-#endif // RPAL_PARSER_H
\ No newline at end of file
+#endif // RPAL_PARSER_H
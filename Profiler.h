@@ -0,0 +1,56 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <map>
+#include <ostream>
+#include <string>
+
+using namespace std;
+
+// Sampling profile of an RPAL program.
+// Every interval machine steps the CSE machine reports its call stack: the names of the
+// functions whose bodies are on the control, outermost first, joined by ';'. A sample counts
+// for the interval steps it stands for, and the profile is written in the collapsed-stack form
+// read by flamegraph tools, one "stack steps" line per distinct stack.
+class Profiler
+{
+private:
+    long long interval;
+    long long countdown;
+    long long samples = 0;
+    map<string, long long> stacks; // steps per collapsed stack
+
+public:
+    explicit Profiler(long long interval = 1000) : interval(interval > 0 ? interval : 1), countdown(this->interval) {}
+
+    // count one machine step; true when this step is to be sampled
+    bool tick()
+    {
+        if (--countdown > 0)
+        {
+            return false;
+        }
+        countdown = interval;
+        return true;
+    }
+
+    // add a sample of the collapsed stack
+    void record(const string &stack)
+    {
+        stacks[stack] += interval;
+        samples++;
+    }
+
+    long long getSamples() const { return samples; }
+
+    // collapsed stacks in sorted order
+    void write(ostream &out) const
+    {
+        for (const auto &entry : stacks)
+        {
+            out << entry.first << ' ' << entry.second << '\n';
+        }
+    }
+};
+
+#endif // PROFILER_H
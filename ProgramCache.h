@@ -0,0 +1,355 @@
+#ifndef PROGRAMCACHE_H
+#define PROGRAMCACHE_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include "Bytecode.h"
+#include "SourceFile.h"
+
+using namespace std;
+
+// On-disk cache of compiled programs.
+// A program is stored as bytecode in a file named by a hash of its source and of the
+// interpreter version, so a changed program or a rebuilt interpreter simply misses. The file
+// also holds the source itself, so a hash collision is a miss rather than a wrong program.
+// On a hit the file is mapped and its instructions are run in place.
+class ProgramCache
+{
+private:
+    // file layout: header, instructions, their source offsets, then the pools and the source,
+    // each one a length followed by its contents
+    struct Header
+    {
+        char magic[8];
+        char version[56];
+        uint64_t sourceSize;
+        uint64_t codeCount;
+        uint64_t blockCount;
+        uint64_t integerCount;
+        uint64_t stringCount;
+        uint64_t nameCount;
+        int64_t etaBlock;
+        uint64_t reserved;
+    };
+    static_assert(sizeof(Header) % alignof(Instr) == 0, "instructions must follow the header aligned");
+
+    static constexpr char MAGIC[8] = {'R', 'P', 'A', 'L', 'B', 'C', '\0', '\0'};
+
+    // reads the variable-length part of a cache file; any overrun marks the file bad
+    struct Reader
+    {
+        string_view data;
+        size_t pos = 0;
+        bool bad = false;
+
+        string_view bytes(size_t count)
+        {
+            if (bad || count > data.size() - pos)
+            {
+                bad = true;
+                return string_view();
+            }
+            string_view result = data.substr(pos, count);
+            pos += count;
+            return result;
+        }
+
+        template <typename T>
+        T number()
+        {
+            T value{};
+            string_view raw = bytes(sizeof(T));
+            if (!bad)
+            {
+                memcpy(&value, raw.data(), sizeof(T));
+            }
+            return value;
+        }
+
+        string_view text() { return bytes(number<uint32_t>()); }
+    };
+
+    template <typename T>
+    static void writeNumber(string &out, T value)
+    {
+        out.append(reinterpret_cast<const char *>(&value), sizeof(T));
+    }
+
+    static void writeText(string &out, string_view text)
+    {
+        writeNumber<uint32_t>(out, static_cast<uint32_t>(text.size()));
+        out.append(text);
+    }
+
+    filesystem::path directory;
+    string version; // of the interpreter writing and reading the files
+    atomic<long long> hits{0};
+    atomic<long long> misses{0};
+    atomic<long long> stores{0};
+
+    // 64-bit FNV-1a
+    static uint64_t hash(string_view bytes, uint64_t value = 14695981039346656037ull)
+    {
+        for (unsigned char c : bytes)
+        {
+            value = (value ^ c) * 1099511628211ull;
+        }
+        return value;
+    }
+
+    filesystem::path pathFor(string_view source) const
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.rpbc", static_cast<unsigned long long>(hash(source, hash(version))));
+        return directory / name;
+    }
+
+    // rebuild a program from the bytes of a cache file; nullptr unless the file holds exactly source
+    unique_ptr<BytecodeProgram> decode(shared_ptr<const SourceFile> file, string_view source)
+    {
+        string_view data = file->view();
+        Header header;
+        if (data.size() < sizeof(Header))
+        {
+            return nullptr;
+        }
+        memcpy(&header, data.data(), sizeof(Header));
+        if (memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 ||
+            string_view(header.version, strnlen(header.version, sizeof(header.version))) != version ||
+            header.sourceSize != source.size() ||
+            header.codeCount > (data.size() - sizeof(Header)) / (sizeof(Instr) + sizeof(uint32_t)))
+        {
+            return nullptr;
+        }
+
+        auto program = make_unique<BytecodeProgram>();
+        program->mappedCode = reinterpret_cast<const Instr *>(data.data() + sizeof(Header));
+        program->mappedOffsets = reinterpret_cast<const uint32_t *>(program->mappedCode + header.codeCount);
+
+        Reader reader{data, sizeof(Header) + header.codeCount * (sizeof(Instr) + sizeof(uint32_t))};
+        unordered_map<string_view, shared_ptr<const string>> interned;
+        auto intern = [&interned](string_view text)
+        {
+            shared_ptr<const string> &name = interned[text];
+            if (name == nullptr)
+            {
+                name = make_shared<const string>(text);
+            }
+            return name;
+        };
+
+        for (uint64_t i = 0; i < header.integerCount && !reader.bad; i++)
+        {
+            program->integers.push_back(reader.number<int64_t>());
+        }
+        for (uint64_t i = 0; i < header.stringCount && !reader.bad; i++)
+        {
+            program->strings.push_back(make_shared<const string>(reader.text()));
+        }
+        for (uint64_t i = 0; i < header.nameCount && !reader.bad; i++)
+        {
+            program->names.push_back(intern(reader.text()));
+        }
+        for (uint64_t i = 0; i < header.blockCount && !reader.bad; i++)
+        {
+            Block block;
+            block.start = reader.number<int32_t>();
+            block.isSingleBoundVar = reader.number<uint8_t>() != 0;
+            uint32_t variables = reader.number<uint32_t>();
+            for (uint32_t v = 0; v < variables && !reader.bad; v++)
+            {
+                block.boundVariables.push_back(string(reader.text()));
+            }
+            if (block.isSingleBoundVar && !block.boundVariables.empty())
+            {
+                block.boundName = intern(block.boundVariables[0]);
+            }
+            program->blocks.push_back(move(block));
+        }
+
+        if (reader.bad || reader.bytes(source.size()) != source || program->blocks.empty() ||
+            header.etaBlock < 0 || header.etaBlock >= static_cast<int64_t>(header.blockCount))
+        {
+            return nullptr;
+        }
+
+        // A damaged file must not send the machine outside its pools: opcodes, constant, name
+        // and block indices and branch targets are checked, and the code must end on a
+        // terminator so execution cannot run past it. Tuple arities and LOAD addresses are not
+        // checked; they are only as sound as the compiler that wrote the file.
+        if (header.codeCount == 0)
+        {
+            return nullptr;
+        }
+        Opcode last = program->mappedCode[header.codeCount - 1].op;
+        if (last != Opcode::HALT && last != Opcode::END && last != Opcode::EXIT_ENV)
+        {
+            return nullptr;
+        }
+        for (uint64_t pc = 0; pc < header.codeCount; pc++)
+        {
+            const Instr &instr = program->mappedCode[pc];
+            if (instr.op > Opcode::HALT ||
+                (instr.op == Opcode::PUSH_INT && static_cast<uint64_t>(instr.a) >= header.integerCount) ||
+                (instr.op == Opcode::PUSH_STR && static_cast<uint64_t>(instr.a) >= header.stringCount) ||
+                (instr.op == Opcode::LOAD && static_cast<uint64_t>(instr.c) >= header.nameCount) ||
+                (instr.op == Opcode::PUSH_LAMBDA && static_cast<uint64_t>(instr.a) >= header.blockCount) ||
+                (instr.op == Opcode::BRANCH &&
+                 (static_cast<uint64_t>(instr.a) >= header.codeCount || static_cast<uint64_t>(instr.b) >= header.codeCount)))
+            {
+                return nullptr;
+            }
+        }
+        for (const Block &block : program->blocks)
+        {
+            if (block.start < 0 || static_cast<uint64_t>(block.start) >= header.codeCount)
+            {
+                return nullptr;
+            }
+        }
+        program->etaBlock = static_cast<int>(header.etaBlock);
+        program->storage = move(file);
+        return program;
+    }
+
+    // the bytes of a cache file for program
+    string encode(const BytecodeProgram &program, string_view source) const
+    {
+        Header header{};
+        memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        version.copy(header.version, sizeof(header.version) - 1);
+        header.sourceSize = source.size();
+        header.codeCount = program.code.size();
+        header.blockCount = program.blocks.size();
+        header.integerCount = program.integers.size();
+        header.stringCount = program.strings.size();
+        header.nameCount = program.names.size();
+        header.etaBlock = program.etaBlock;
+
+        string out(reinterpret_cast<const char *>(&header), sizeof(Header));
+        for (const Instr &instr : program.code)
+        {
+            // copied field by field into a value-initialized instruction
+            Instr packed{};
+            packed.op = instr.op;
+            packed.a = instr.a;
+            packed.b = instr.b;
+            packed.c = instr.c;
+            out.append(reinterpret_cast<const char *>(&packed), sizeof(Instr));
+        }
+        out.append(reinterpret_cast<const char *>(program.offsets.data()), program.offsets.size() * sizeof(uint32_t));
+
+        for (long long integer : program.integers)
+        {
+            writeNumber<int64_t>(out, integer);
+        }
+        for (const auto &text : program.strings)
+        {
+            writeText(out, *text);
+        }
+        for (const auto &name : program.names)
+        {
+            writeText(out, *name);
+        }
+        for (const Block &block : program.blocks)
+        {
+            writeNumber<int32_t>(out, block.start);
+            writeNumber<uint8_t>(out, block.isSingleBoundVar);
+            writeNumber<uint32_t>(out, static_cast<uint32_t>(block.boundVariables.size()));
+            for (const string &variable : block.boundVariables)
+            {
+                writeText(out, variable);
+            }
+        }
+        out.append(source);
+        return out;
+    }
+
+public:
+    // version names the interpreter build; files written under another version are never used
+    ProgramCache(filesystem::path directory, string version) : directory(move(directory)), version(move(version)) {}
+
+    // $RPAL_CACHE_DIR, else the user cache directory, else .rpalcache in the working directory
+    static filesystem::path defaultDirectory()
+    {
+        if (const char *dir = getenv("RPAL_CACHE_DIR"))
+        {
+            return dir;
+        }
+        if (const char *dir = getenv("XDG_CACHE_HOME"))
+        {
+            return filesystem::path(dir) / "myrpal";
+        }
+        if (const char *dir = getenv("HOME"))
+        {
+            return filesystem::path(dir) / ".cache" / "myrpal";
+        }
+        return ".rpalcache";
+    }
+
+    // the compiled program of source, or nullptr on a miss
+    unique_ptr<BytecodeProgram> find(string_view source)
+    {
+        auto file = make_shared<SourceFile>();
+        unique_ptr<BytecodeProgram> program;
+        error_code error;
+        filesystem::path path = pathFor(source);
+        if (filesystem::is_regular_file(path, error) && file->open(path.string()))
+        {
+            program = decode(move(file), source);
+        }
+
+        (program != nullptr ? hits : misses)++;
+        return program;
+    }
+
+    // save the compiled program of source; a cache that cannot be written is skipped
+    void store(string_view source, const BytecodeProgram &program)
+    {
+        error_code error;
+        filesystem::create_directories(directory, error);
+        filesystem::path path = pathFor(source);
+
+        // written aside and renamed, so a reader never maps a half-written file
+        ostringstream suffix;
+        suffix << ".tmp" << this_thread::get_id();
+        filesystem::path temporary = path;
+        temporary += suffix.str();
+
+        string bytes = encode(program, source);
+        {
+            ofstream out(temporary, ios::binary | ios::trunc);
+            if (!out.write(bytes.data(), bytes.size()))
+            {
+                return;
+            }
+        }
+        filesystem::rename(temporary, path, error);
+        if (error)
+        {
+            filesystem::remove(temporary, error);
+            return;
+        }
+        stores++;
+    }
+
+    const filesystem::path &getDirectory() const { return directory; }
+
+    long long getHits() const { return hits; }
+
+    long long getMisses() const { return misses; }
+
+    long long getStores() const { return stores; }
+};
+
+#endif // PROGRAMCACHE_H
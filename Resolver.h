@@ -0,0 +1,134 @@
+#ifndef RESOLVER_H
+#define RESOLVER_H
+
+#include <vector>
+#include <utility>
+#include "TreeNode.h"
+#include "SymbolTable.h"
+
+using namespace std;
+
+// Resolves identifier references of the standardized tree to lexical addresses.
+// Depth counts the lambdas between a reference and its binder, slot is the position of the
+// variable in that binder; every gamma on a lambda creates exactly one environment frame,
+// so the address is valid at run time. Free identifiers keep depth -1 and carry their
+// built-in code as slot, or -1 when the name is unknown.
+class Resolver
+{
+private:
+    vector<vector<pair<int, int>>> bindings; // symbol -> (lambda level, slot) of visible binders
+    int level = 0;                           // lambdas enclosing the current node
+
+    // built-ins are the first symbols interned, in Builtin order
+    static int builtinCode(int symbol)
+    {
+        if (symbol >= 0 && symbol <= static_cast<int>(Builtin::NIL))
+        {
+            return symbol;
+        }
+        return symbol == SymbolTable::PRINT_ALIAS ? static_cast<int>(Builtin::PRINT) : -1;
+    }
+
+    vector<pair<int, int>> &bindersOf(int symbol)
+    {
+        if (static_cast<size_t>(symbol) >= bindings.size())
+        {
+            bindings.resize(symbol + 1);
+        }
+        return bindings[symbol];
+    }
+
+    // variables a lambda binds, in slot order
+    static NodeSpan boundVars(TreeNode *lambda)
+    {
+        NodeSpan children = lambda->getChildren();
+        if (children[0]->getKind() == NodeKind::COMMA)
+        {
+            return children[0]->getChildren();
+        }
+        return NodeSpan(children.begin(), 1);
+    }
+
+    // Walk the tree with an explicit stack, so deep nesting cannot overflow the native stack.
+    // A lambda's binders stay visible until the walk leaves its body.
+    void resolve(TreeNode *root)
+    {
+        struct Item
+        {
+            TreeNode *node;
+            bool leave; // the lambda's body is done
+        };
+
+        vector<Item> pending = {{root, false}};
+
+        while (!pending.empty())
+        {
+            Item item = pending.back();
+            pending.pop_back();
+            TreeNode *node = item.node;
+
+            if (node->getKind() == NodeKind::LAMBDA)
+            {
+                NodeSpan vars = boundVars(node);
+
+                if (item.leave)
+                {
+                    for (TreeNode *var : vars)
+                    {
+                        if (var->getKind() == NodeKind::IDENTIFIER)
+                        {
+                            bindersOf(var->getSymbol()).pop_back();
+                        }
+                    }
+                    level--;
+                    continue;
+                }
+
+                level++;
+                for (int slot = 0; slot < static_cast<int>(vars.size()); slot++)
+                {
+                    // () binds nothing
+                    if (vars[slot]->getKind() == NodeKind::IDENTIFIER)
+                    {
+                        bindersOf(vars[slot]->getSymbol()).push_back({level, slot});
+                    }
+                }
+
+                pending.push_back({node, true});
+                pending.push_back({node->getChildren()[1], false});
+            }
+            else if (node->getKind() == NodeKind::IDENTIFIER)
+            {
+                vector<pair<int, int>> &binders = bindersOf(node->getSymbol());
+
+                if (!binders.empty())
+                {
+                    node->setAddress(level - binders.back().first, binders.back().second);
+                }
+                else
+                {
+                    node->setAddress(-1, builtinCode(node->getSymbol()));
+                }
+            }
+            else
+            {
+                for (TreeNode *child : node->getChildren())
+                {
+                    pending.push_back({child, false});
+                }
+            }
+        }
+    }
+
+public:
+    // annotate every identifier reference below root with its lexical address
+    static void resolveTree(TreeNode *root)
+    {
+        if (root != nullptr)
+        {
+            Resolver().resolve(root);
+        }
+    }
+};
+
+#endif // RESOLVER_H
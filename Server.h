@@ -0,0 +1,252 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include "Interpreter.h"
+#include "ProgramCache.h"
+
+#ifndef _WIN32
+#include <csignal>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+// Programs and their outputs travel as frames: a header line holding the payload length in
+// bytes, followed by exactly that many bytes. A request header is just the length; a reply
+// header is "ok <length>" or "error <length>", and an error reply carries whatever the program
+// printed before it failed followed by the error message.
+//
+//     12\nPrint(1 + 2)        ->  ok 1\n3
+
+// largest request the server accepts, so a bad header cannot make it allocate without bound
+constexpr size_t MAX_FRAME_SIZE = 64 << 20;
+
+// read one frame of at most maxSize bytes into payload; false at end of input
+inline bool readFrame(istream &in, string &header, string &payload, size_t maxSize = MAX_FRAME_SIZE)
+{
+    if (!getline(in, header))
+    {
+        return false;
+    }
+    if (!header.empty() && header.back() == '\r')
+    {
+        header.pop_back();
+    }
+
+    size_t space = header.rfind(' ');
+    string length = header.substr(space == string::npos ? 0 : space + 1);
+    if (length.empty() || length.find_first_not_of("0123456789") != string::npos)
+    {
+        throw runtime_error("Malformed frame header: " + header);
+    }
+    // more digits than any accepted size may not fit in size_t
+    size_t size = length.size() > 18 ? SIZE_MAX : stoull(length);
+    if (size > maxSize)
+    {
+        throw runtime_error("Frame too large: " + length + " bytes, at most " + to_string(maxSize) + " allowed");
+    }
+
+    payload.resize(size);
+    if (!in.read(payload.data(), size))
+    {
+        throw runtime_error("Frame ended early");
+    }
+    return true;
+}
+
+// write one frame; tag is empty for a request
+inline void writeFrame(ostream &out, const string &tag, string_view payload)
+{
+    if (!tag.empty())
+    {
+        out << tag << ' ';
+    }
+    out << payload.size() << '\n';
+    out.write(payload.data(), payload.size());
+    out.flush();
+}
+
+// Answer request frames from in on out until in ends.
+// The interpreter is reused, so after the first program a request costs only its own run.
+inline void serveStream(Interpreter &interpreter, istream &in, ostream &out)
+{
+    string header;
+    string source;
+    try
+    {
+        while (readFrame(in, header, source))
+        {
+            string reply;
+            string error;
+            try
+            {
+                interpreter.load(source);
+                interpreter.execute(reply);
+            }
+            catch (const exception &exception)
+            {
+                error = string("Error: ") + exception.what() + "\n";
+            }
+
+            if (!error.empty() && !reply.empty() && reply.back() != '\n')
+            {
+                reply += '\n';
+            }
+            writeFrame(out, error.empty() ? "ok" : "error", reply + error);
+        }
+    }
+    catch (const exception &exception)
+    {
+        // the stream cannot be resynchronised after a bad frame
+        writeFrame(out, "error", string("Error: ") + exception.what() + "\n");
+    }
+}
+
+#ifndef _WIN32
+// Stream buffer over a socket, so frames are read and written the same way as on stdin
+class SocketStreamBuf : public streambuf
+{
+private:
+    int fd;
+    char input[4096];
+    char output[4096];
+
+protected:
+    int_type underflow() override
+    {
+        ssize_t count = ::read(fd, input, sizeof(input));
+        if (count <= 0)
+        {
+            return traits_type::eof();
+        }
+        setg(input, input, input + count);
+        return traits_type::to_int_type(input[0]);
+    }
+
+    int_type overflow(int_type c) override
+    {
+        if (sync() != 0)
+        {
+            return traits_type::eof();
+        }
+        if (!traits_type::eq_int_type(c, traits_type::eof()))
+        {
+            *pptr() = traits_type::to_char_type(c);
+            pbump(1);
+        }
+        return traits_type::not_eof(c);
+    }
+
+    int sync() override
+    {
+        const char *next = pbase();
+        while (next < pptr())
+        {
+            ssize_t count = ::write(fd, next, pptr() - next);
+            if (count <= 0)
+            {
+                return -1;
+            }
+            next += count;
+        }
+        setp(output, output + sizeof(output));
+        return 0;
+    }
+
+public:
+    explicit SocketStreamBuf(int fd) : fd(fd) { setp(output, output + sizeof(output)); }
+
+    ~SocketStreamBuf() override
+    {
+        sync();
+        close(fd);
+    }
+};
+
+// address of a Unix domain socket; throws when the path does not fit
+inline sockaddr_un socketAddress(const string &path)
+{
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path))
+    {
+        throw runtime_error("Socket path too long: " + path);
+    }
+    path.copy(address.sun_path, path.size());
+    return address;
+}
+
+// Accept connections on a Unix domain socket for ever.
+// Each connection gets its own thread and interpreter and may send any number of programs;
+// all of them share cache when it is not null. closed, when set, runs on the connection's
+// thread after the client hangs up.
+inline void serveSocket(const string &path, bool useBytecode, ProgramCache *cache = nullptr,
+                        function<void()> closed = nullptr)
+{
+    sockaddr_un address = socketAddress(path);
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0)
+    {
+        throw runtime_error("Unable to create socket");
+    }
+
+    unlink(path.c_str()); // a socket left behind by an earlier server
+    if (bind(listener, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 || listen(listener, 64) != 0)
+    {
+        close(listener);
+        throw runtime_error("Unable to listen on " + path);
+    }
+
+    // a client that hangs up early must not take the server down with it
+    signal(SIGPIPE, SIG_IGN);
+
+    while (true)
+    {
+        int connection = accept(listener, nullptr, nullptr);
+        if (connection < 0)
+        {
+            continue;
+        }
+
+        thread([connection, useBytecode, cache, closed]
+               {
+                   {
+                       SocketStreamBuf buffer(connection);
+                       istream in(&buffer);
+                       ostream out(&buffer);
+                       Interpreter interpreter(useBytecode);
+                       interpreter.setCache(cache);
+                       serveStream(interpreter, in, out);
+                   }
+                   if (closed)
+                   {
+                       closed();
+                   } })
+            .detach();
+    }
+}
+
+// connect to a server's socket; returns the descriptor, or -1 when nothing is listening
+inline int connectSocket(const string &path)
+{
+    sockaddr_un address = socketAddress(path);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd >= 0 && connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0)
+    {
+        close(fd);
+        fd = -1;
+    }
+    return fd;
+}
+#endif
+
+#endif // SERVER_H
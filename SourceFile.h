@@ -0,0 +1,114 @@
+#ifndef SOURCEFILE_H
+#define SOURCEFILE_H
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <string_view>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+using namespace std;
+
+// Read-only view of a program source.
+// Regular files are memory mapped so the lexer scans the pages directly; stdin ("-"), pipes
+// and platforms without mmap fall back to reading the stream into a buffer.
+class SourceFile
+{
+private:
+    const char *data = nullptr;
+    size_t length = 0;
+    bool mapped = false;
+    string buffer; // contents when the source could not be mapped
+
+    // read a stream into the buffer
+    void readStream(istream &in)
+    {
+        buffer.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+        data = buffer.data();
+        length = buffer.size();
+    }
+
+#ifndef _WIN32
+    // map a regular, non-empty file; false when the file has to be streamed instead
+    bool map(int fd)
+    {
+        struct stat info;
+        if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode) || info.st_size == 0)
+        {
+            return false;
+        }
+
+        void *pages = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (pages == MAP_FAILED)
+        {
+            return false;
+        }
+        madvise(pages, info.st_size, MADV_SEQUENTIAL);
+
+        data = static_cast<const char *>(pages);
+        length = info.st_size;
+        mapped = true;
+        return true;
+    }
+#endif
+
+public:
+    SourceFile() = default;
+
+    SourceFile(const SourceFile &) = delete;
+    SourceFile &operator=(const SourceFile &) = delete;
+
+    ~SourceFile()
+    {
+#ifndef _WIN32
+        if (mapped)
+        {
+            munmap(const_cast<char *>(data), length);
+        }
+#endif
+    }
+
+    // open a source file, or stdin when path is "-"; false when it cannot be read
+    bool open(const string &path)
+    {
+        if (path == "-")
+        {
+            readStream(cin);
+            return true;
+        }
+
+#ifndef _WIN32
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            return false;
+        }
+        bool isMapped = map(fd);
+        close(fd);
+
+        if (isMapped)
+        {
+            return true;
+        }
+#endif
+
+        ifstream file(path, ios::binary);
+        if (!file.is_open())
+        {
+            return false;
+        }
+        readStream(file);
+        return true;
+    }
+
+    // the source text; valid while this object lives
+    string_view view() const { return string_view(data == nullptr ? "" : data, length); }
+};
+
+#endif // SOURCEFILE_H
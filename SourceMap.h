@@ -0,0 +1,67 @@
+#ifndef SOURCEMAP_H
+#define SOURCEMAP_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+// offset of a node that has no place in the source
+constexpr uint32_t NO_OFFSET = UINT32_MAX;
+
+// Lines of a program's source.
+// Tokens, tree nodes and control structures record where they came from as a byte offset
+// into the source; the map turns an offset into a line and column only when one is reported.
+class SourceMap
+{
+private:
+    vector<uint32_t> lineStarts = {0}; // offset of the first byte of each line
+
+public:
+    SourceMap() = default;
+
+    explicit SourceMap(string_view source) { reset(source); }
+
+    // map the lines of another source
+    void reset(string_view source)
+    {
+        lineStarts.assign(1, 0);
+        const char *begin = source.data();
+        const char *end = begin + source.size();
+        for (const char *p = begin; (p = static_cast<const char *>(memchr(p, '\n', end - p))) != nullptr;)
+        {
+            p++;
+            lineStarts.push_back(static_cast<uint32_t>(p - begin));
+        }
+    }
+
+    // 1-based line of an offset
+    int line(uint32_t offset) const
+    {
+        return static_cast<int>(upper_bound(lineStarts.begin(), lineStarts.end(), offset) - lineStarts.begin());
+    }
+
+    // 1-based column of an offset, counted in bytes
+    int column(uint32_t offset) const
+    {
+        return static_cast<int>(offset - lineStarts[line(offset) - 1]) + 1;
+    }
+
+    // "line L, column C"
+    string describe(uint32_t offset) const
+    {
+        return "line " + to_string(line(offset)) + ", column " + to_string(column(offset));
+    }
+
+    // describe an offset of a source that has no map, scanning it once; for errors raised while parsing
+    static string describe(string_view source, uint32_t offset)
+    {
+        return SourceMap(source.substr(0, min<size_t>(offset, source.size()))).describe(offset);
+    }
+};
+
+#endif // SOURCEMAP_H
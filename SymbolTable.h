@@ -0,0 +1,91 @@
+#ifndef SYMBOLTABLE_H
+#define SYMBOLTABLE_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+
+using namespace std;
+
+// built-in functions, resolved by name at compile time
+enum class Builtin : int
+{
+    PRINT,
+    ORDER,
+    Y_STAR,
+    CONC,
+    STEM,
+    STERN,
+    ISINTEGER,
+    ISSTRING,
+    ISTUPLE,
+    ISEMPTY,
+    DUMMY,
+    ITOS,
+    NIL
+};
+
+// Interned identifier names shared by the lexer, the parser and the CSE machine of one interpreter.
+// Every name is stored once; tree nodes and control nodes refer to it by id or share its buffer.
+// The built-ins are interned first, so the symbol of a built-in is its Builtin code.
+class SymbolTable
+{
+private:
+    vector<shared_ptr<const string>> names;
+    unordered_map<string_view, int> ids; // keys view the strings in names
+    int predefinedCount = 0;
+
+public:
+    static constexpr int PRINT_ALIAS = static_cast<int>(Builtin::NIL) + 1; // "print"
+    static constexpr int REC_WORD = PRINT_ALIAS + 1;                       // "rec" lexes as an identifier
+
+    SymbolTable()
+    {
+        static const char *predefined[] = {"Print", "Order", "Y*", "Conc", "Stem", "Stern", "Isinteger", "Isstring",
+                                           "Istuple", "Isempty", "dummy", "ItoS", "nil", "print", "rec"};
+        for (const char *name : predefined)
+        {
+            intern(name);
+        }
+        predefinedCount = size();
+    }
+
+    SymbolTable(const SymbolTable &) = delete;
+    SymbolTable &operator=(const SymbolTable &) = delete;
+
+    // forget every name but the predefined ones; buffers already shared stay alive with their holders
+    void reset()
+    {
+        for (int id = predefinedCount; id < size(); id++)
+        {
+            ids.erase(string_view(*names[id]));
+        }
+        names.resize(predefinedCount);
+    }
+
+    // id of a name, adding it on first sight
+    int intern(string_view name)
+    {
+        auto it = ids.find(name);
+        if (it != ids.end())
+        {
+            return it->second;
+        }
+
+        names.push_back(make_shared<const string>(name));
+        int id = static_cast<int>(names.size()) - 1;
+        ids.emplace(string_view(*names.back()), id);
+        return id;
+    }
+
+    // shared buffer holding the name of a symbol
+    const shared_ptr<const string> &name(int id) const { return names[id]; }
+
+    string_view view(int id) const { return *names[id]; }
+
+    int size() const { return static_cast<int>(names.size()); }
+};
+
+#endif // SYMBOLTABLE_H
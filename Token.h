@@ -1,7 +1,9 @@
 #ifndef TOKEN_H
 #define TOKEN_H
 
+#include <cstdint>
 #include <string>
+#include <string_view>
 using namespace std;
 
 // enumerate token types
@@ -16,10 +18,53 @@ enum tokenType
     END_OF_FILE
 };
 
+// token classified for the parser, so a production switches on one byte instead of comparing text
+enum class TokenKind : unsigned char
+{
+    IDENTIFIER,
+    INTEGER, // true and false lex as 1 and 0
+    STRING,
+    LET,
+    IN,
+    FN,
+    WHERE,
+    WITHIN,
+    AUG,
+    AND,
+    OR,
+    NOT,
+    GR, // gr and >
+    GE, // ge and >=
+    LS, // ls and <
+    LE, // le and <=
+    EQ, // eq
+    NE, // ne and !=
+    PLUS,
+    MINUS,
+    TIMES,
+    DIVIDE,
+    POWER,  // **
+    AT,     // @
+    EQUALS, // = of a definition
+    AMPERSAND,
+    ARROW, // ->
+    BAR,   // |
+    COMMA,
+    DOT,
+    LEFT_PAREN,
+    RIGHT_PAREN,
+    OTHER, // any other run of operator symbols
+    END_OF_FILE
+};
+
+// value is a view into the lexer input (or lexer-owned storage for decoded strings)
 struct Token
 {
     tokenType type;
-    string value;
+    TokenKind kind;
+    string_view value;
+    int symbol = -1;     // interned name of an identifier
+    uint32_t offset = 0; // byte offset of the token in the input; fits the padding, so tokens do not grow
 };
 
 #endif // TOKEN_H
\ No newline at end of file
@@ -2,31 +2,33 @@
 #define TREE_H
 
 #include "TreeNode.h"
+#include "SymbolTable.h"
 
-// Function to generate symbol table
-void generateST(TreeNode *currentNode, TreeNode *parentNode);
+class Tree;
 
-// Tree structure
+// Standardize a tree; new nodes come from tree. Returns the root of the standardized tree
+TreeNode *generateST(Tree &tree, TreeNode *root);
+
+// Name each lambda of a standardized tree after the definition it is bound to, for profiles
+// and error messages
+void nameLambdas(TreeNode *root);
+
+// Tree structure.
+// Each interpreter owns one tree; its nodes live in the tree's arena until release().
 class Tree
 {
 private:
-    static Tree *tree;           // Singleton instance of the tree
+    const SymbolTable &symbols;  // Names of identifier nodes
     TreeNode *astRoot = nullptr; // Root node of the abstract syntax tree (AST)
-    TreeNode *stRoot = nullptr;  // Root node of the symbol table (ST)
+    TreeNode *stRoot = nullptr;  // Root node of the standardized tree (ST)
+    Arena arena;                 // Owns every node of the AST and the ST
 
-    // Constructor and destructor
-    Tree() {}
-    ~Tree() {}
+public:
+    explicit Tree(const SymbolTable &symbols) : symbols(symbols) {}
 
     Tree(const Tree &) = delete;
     Tree &operator=(const Tree &) = delete;
 
-public:
-    static Tree &getInstance() // Get the singleton instance of the tree
-    {
-        return *tree;
-    }
-
     void setASTRoot(TreeNode *root) // Set the root node of the AST
     {
         astRoot = root;
@@ -37,38 +39,57 @@ public:
         return astRoot;
     }
 
-    void setSTRoot(TreeNode *root) // Set the root node of the symbol table
+    void setSTRoot(TreeNode *root) // Set the root node of the standardized tree
     {
         stRoot = root;
     }
 
-    TreeNode *getSTRoot() // Get the root node of the symbol table
+    TreeNode *getSTRoot() // Get the root node of the standardized tree
     {
         return stRoot;
     }
 
-    static void releaseASTMemory() // Release the memory of the AST
+    const SymbolTable &getSymbols() const // Names of the identifiers in the tree
     {
-        if (tree->astRoot != nullptr)
-        {
-            if (tree->stRoot == nullptr)
-            {
-                tree->stRoot = tree->astRoot;
-            }
-            tree->astRoot = nullptr;
-        }
+        return symbols;
+    }
+
+    Arena &getArena() // Arena the nodes of the tree are allocated from
+    {
+        return arena;
     }
 
-    static void releaseSTMemory() // Release the memory of the symbol table
+    TreeNode *internalNode(NodeKind kind, uint32_t offset = NO_OFFSET) // Create an internal node in the tree's arena
     {
-        TreeNode::releaseNodeMemory(tree->stRoot);
+        return TreeNode::internal(arena, kind, offset);
     }
 
-    // Generate symbol table from the AST
-    static void generate()
+    TreeNode *leafNode(NodeKind kind, string_view value, uint32_t offset = NO_OFFSET) // Create a leaf node in the tree's arena
     {
-        releaseASTMemory();
-        generateST(tree->stRoot, nullptr);
+        return TreeNode::leaf(arena, kind, value, offset);
+    }
+
+    TreeNode *identifierNode(int symbol, uint32_t offset = NO_OFFSET) // Create an identifier leaf in the tree's arena
+    {
+        return TreeNode::identifier(arena, symbols, symbol, offset);
+    }
+
+    void release() // Release every tree node at once; the nodes are not visited
+    {
+        arena.release();
+        astRoot = nullptr;
+        stRoot = nullptr;
+    }
+
+    // Standardize the AST in place; the AST root is handed over to the standardized tree
+    void generate()
+    {
+        if (astRoot != nullptr)
+        {
+            stRoot = generateST(*this, astRoot);
+            nameLambdas(stRoot);
+            astRoot = nullptr;
+        }
     }
 };
 
@@ -2,124 +2,285 @@
 #define TREENODE_H
 
 #include <string>
-#include <vector>
+#include <string_view>
 #include <algorithm>
 #include <utility>
 #include <stdexcept>
+#include "Arena.h"
+#include "SymbolTable.h"
+#include "SourceMap.h"
 
 using namespace std;
 
-// TreeNode Structure representing a node in the tree
+// kinds of AST and ST nodes
+enum class NodeKind : unsigned char
+{
+    LET,
+    LAMBDA,
+    WHERE,
+    TAU,
+    AUG,
+    CONDITIONAL, // ->
+    OR,
+    AMPERSAND, // &
+    NOT,
+    GR,
+    GE,
+    LS,
+    LE,
+    EQ,
+    NE,
+    PLUS,
+    MINUS,
+    NEG,
+    MULTIPLY,
+    DIVIDE,
+    POWER, // **
+    AT,    // @
+    GAMMA,
+    IDENTIFIER,
+    INTEGER,
+    STRING,
+    TRUE_VALUE,
+    FALSE_VALUE,
+    NIL,
+    DUMMY,
+    WITHIN,
+    AND, // simultaneous definitions
+    REC,
+    EQUALS, // =
+    FCN_FORM,
+    EMPTY_PARAMS, // ()
+    COMMA
+};
+
+constexpr int NODE_KIND_COUNT = static_cast<int>(NodeKind::COMMA) + 1;
+
+// label of a node kind, as printed in the AST
+inline string_view nodeLabel(NodeKind kind)
+{
+    static const string_view labels[] = {"let", "lambda", "where", "tau", "aug", "->", "or", "&", "not", "gr", "ge", "ls", "le",
+                                         "eq", "ne", "+", "-", "neg", "*", "/", "**", "@", "gamma", "identifier", "integer",
+                                         "string", "true", "false", "nil", "dummy", "within", "and", "rec", "=", "fcn_form",
+                                         "()", ","};
+    return labels[static_cast<int>(kind)];
+}
+
+class TreeNode;
+
+// View of the children of a node; the array lives in the node's arena
+class NodeSpan
+{
+private:
+    TreeNode **first = nullptr;
+    size_t count = 0;
+
+public:
+    NodeSpan() = default;
+
+    NodeSpan(TreeNode **first, size_t count) : first(first), count(count) {}
+
+    TreeNode **begin() const { return first; }
+
+    TreeNode **end() const { return first + count; }
+
+    size_t size() const { return count; }
+
+    bool empty() const { return count == 0; }
+
+    TreeNode *operator[](size_t index) const { return first[index]; }
+
+    TreeNode *front() const { return first[0]; }
+
+    TreeNode *back() const { return first[count - 1]; }
+
+    // Drop the first or last node from the view
+    void pop_front()
+    {
+        first++;
+        count--;
+    }
+
+    void pop_back() { count--; }
+};
+
+// TreeNode Structure representing a node in the tree.
+// Nodes, their strings and their child arrays are allocated from one arena and released with it.
+// The value is kept as a pointer and a 32-bit length, so the source offset fits beside it
+// without growing the node.
 class TreeNode
 {
 private:
-    string label;                // Label of the node
-    vector<TreeNode *> children; // Children nodes of the current node
-    string value;                // Value associated with the node
+    Arena *arena;                  // Arena owning this node
+    NodeKind kind;                 // Kind of the node
+    int symbol = -1;               // Interned name of an identifier, or of the definition a lambda is bound to
+    const char *valueData;         // Value associated with the node
+    uint32_t valueSize;
+    uint32_t offset;               // Byte offset in the source of the construct the node came from
+    TreeNode **children = nullptr; // Children nodes of the current node
+    int numChildren = 0;
+    int capacity = 0;
+    int depth = -1; // Lexical address of an identifier reference (-1 when free)
+    int slot = -1;
 
 public:
-    // Constructor initializing the label
-    explicit TreeNode(string lbl) : label(move(lbl))
+    TreeNode(Arena *arena, NodeKind kind, string_view v, uint32_t offset)
+        : arena(arena), kind(kind), valueData(v.data()), valueSize(static_cast<uint32_t>(v.size())), offset(offset) {}
+
+    // Create an internal node; internal nodes carry " " as their value
+    static TreeNode *internal(Arena &arena, NodeKind kind, uint32_t offset = NO_OFFSET)
     {
-        children = vector<TreeNode *>(); // Initialize children vector
+        return arena.create<TreeNode>(&arena, kind, " ", offset);
+    }
+
+    // Create a leaf node with a kind and value
+    static TreeNode *leaf(Arena &arena, NodeKind kind, string_view v, uint32_t offset = NO_OFFSET)
+    {
+        return arena.create<TreeNode>(&arena, kind, arena.copy(v), offset);
+    }
+
+    // Create an identifier leaf; its value views the interned name
+    static TreeNode *identifier(Arena &arena, const SymbolTable &symbols, int symbol, uint32_t offset = NO_OFFSET)
+    {
+        TreeNode *node = arena.create<TreeNode>(&arena, NodeKind::IDENTIFIER, symbols.view(symbol), offset);
+        node->symbol = symbol;
+        return node;
     }
 
     // Add a child node to the current node
     void addChild(TreeNode *child)
     {
-        children.push_back(child);
+        if (numChildren == capacity)
+        {
+            int newCapacity = capacity == 0 ? 2 : capacity * 2;
+            TreeNode **grown = arena->allocateArray<TreeNode *>(newCapacity);
+            copy(children, children + numChildren, grown);
+            children = grown;
+            capacity = newCapacity;
+        }
+        children[numChildren++] = child;
+    }
+
+    // Replace the child at index
+    void setChild(int index, TreeNode *child)
+    {
+        children[index] = child;
+    }
+
+    // Keep only the first count children
+    void truncateChildren(int count)
+    {
+        numChildren = count;
     }
 
     // Reverse the order of children
     void reverseChildren()
     {
-        reverse(children.begin(), children.end());
+        reverse(children, children + numChildren);
     }
 
-    // Remove a child node from the current node
-    void removeChild(int index = 0, bool deleteNode = false)
+    // Remove a child node from the current node.
+    // Removing the first child only advances the array, so it is O(1); the slot it leaves
+    // is never written again, so spans taken before the removal stay valid.
+    void removeChild(int index = 0)
     {
-        if (index < 0 || index >= children.size())
+        if (index < 0 || index >= numChildren)
         {
             throw out_of_range("Index out of range");
         }
 
-        if (deleteNode)
+        if (index == 0)
         {
-            releaseNodeMemory(children[index]);
+            children++;
+            capacity--;
         }
-
-        children.erase(children.begin() + index);
+        else
+        {
+            copy(children + index + 1, children + numChildren, children + index);
+        }
+        numChildren--;
     }
 
     // Get the number of children
     int getNumChildren()
     {
-        return children.size();
+        return numChildren;
+    }
+
+    // Get the kind of the node
+    NodeKind getKind() const
+    {
+        return kind;
+    }
+
+    // Change the kind of the node; the standardizer reuses nodes in place
+    void setKind(NodeKind k)
+    {
+        kind = k;
     }
 
     // Get the label of the node
-    string getLabel()
+    string_view getLabel() const
     {
-        return label;
+        return nodeLabel(kind);
     }
 
-    // Get a reference to the children vector
-    vector<TreeNode *> &getChildren()
+    // Get the interned name of an identifier, or the name a lambda is bound to (-1 when anonymous)
+    int getSymbol() const
     {
-        return children;
+        return symbol;
     }
 
-    // Get the value of the node
-    virtual string getValue()
+    // Name a lambda after the definition it is bound to
+    void setSymbol(int s)
     {
-        return value;
+        symbol = s;
     }
 
-    // Set the value of the node
-    void setValue(string v)
+    // Get a view of the children
+    NodeSpan getChildren()
     {
-        value = move(v);
+        return NodeSpan(children, numChildren);
     }
 
-    // Release memory of the node and its children recursively
-    static void releaseNodeMemory(TreeNode *node)
+    // Get the value of the node
+    string_view getValue() const
     {
-        if (node == nullptr)
-            return;
+        return string_view(valueData, valueSize);
+    }
 
-        for (TreeNode *child : node->getChildren())
-        {
-            releaseNodeMemory(child);
-        }
+    // Set the value of the node
+    void setValue(string_view v)
+    {
+        string_view copy = arena->copy(v);
+        valueData = copy.data();
+        valueSize = static_cast<uint32_t>(copy.size());
+    }
 
-        delete node;
+    // Get the source offset of the node (NO_OFFSET when it has none)
+    uint32_t getOffset() const
+    {
+        return offset;
     }
-};
 
-// InternalNode representing an internal node in the tree
-class InternalNode : public TreeNode
-{
-public:
-    // Constructor for internal node with a label and optional value
-    InternalNode(const string &lbl, const string &v = " ") : TreeNode(lbl)
+    // Set the lexical address of an identifier reference
+    void setAddress(int d, int s)
     {
-        setValue(" ");
+        depth = d;
+        slot = s;
     }
-};
 
-// LeafNode representing a leaf node in the tree
-class LeafNode : public TreeNode
-{
-public:
-    // Constructor for leaf node with a label and value
-    LeafNode(const string &lbl, const string &v) : TreeNode(lbl)
+    // Get the number of lambdas between the reference and its binder
+    int getDepth() const
     {
-        setValue(v);
+        return depth;
     }
 
-    // Prevent adding children to leaf nodes
-    void addChild(TreeNode *child) = delete;
+    // Get the position of the variable in its binder
+    int getSlot() const
+    {
+        return slot;
+    }
 };
 
 #endif // TREENODE_H
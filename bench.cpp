@@ -0,0 +1,354 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "Batch.h"
+#include "HeapCounter.h"
+#include "LexicalAnalyzer.h"
+#include "Parser.h"
+#include "Tree.h"
+#include "Resolver.h"
+#include "Bytecode.h"
+#include "CSEMachine.h"
+#include "OutputSink.h"
+#include "SourceFile.h"
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+// Benchmarks of the interpreter phases.
+// Each benchmark runs every phase separately, repeating the whole pipeline until enough time
+// has passed, and prints one JSON object per phase on its own line. On POSIX systems each
+// benchmark runs in a child process, so the peak RSS reported is its own and a crash is
+// reported instead of ending the run.
+
+enum Phase
+{
+    LEX,
+    PARSE,
+    STANDARDIZE, // includes resolving identifiers
+    COMPILE,
+    EVALUATE,
+    BYTECODE_COMPILE,
+    BYTECODE_EVALUATE,
+    PHASE_COUNT
+};
+
+static const char *phaseNames[PHASE_COUNT] = {"lex",      "parse",           "standardize",      "compile",
+                                              "evaluate", "bytecode_compile", "bytecode_evaluate"};
+
+struct PhaseTotals
+{
+    double nanos = 0;
+    long long allocations = 0;
+    long long bytes = 0;
+};
+
+struct Benchmark
+{
+    string name;
+    long long size; // generator size, or source bytes for a program file
+    string source;
+};
+
+using Clock = chrono::steady_clock;
+
+// run one phase, adding its time and allocations to totals
+static void measure(PhaseTotals &totals, const function<void()> &phase)
+{
+    long long allocationsBefore = HeapCounter::allocations;
+    long long bytesBefore = HeapCounter::bytes;
+    Clock::time_point start = Clock::now();
+    phase();
+    totals.nanos += chrono::duration<double, nano>(Clock::now() - start).count();
+    totals.allocations += HeapCounter::allocations - allocationsBefore;
+    totals.bytes += HeapCounter::bytes - bytesBefore;
+}
+
+// one pass of the whole pipeline, each phase measured on its own
+static void runPipeline(const string &source, PhaseTotals (&totals)[PHASE_COUNT])
+{
+    SymbolTable symbols;
+    measure(totals[LEX], [&]
+            {
+                CustomLexer lexer(source, symbols);
+                while (lexer.getNextToken().type != tokenType::END_OF_FILE)
+                {
+                }
+            });
+    symbols.reset();
+
+    Tree tree(symbols);
+    measure(totals[PARSE], [&]
+            {
+                CustomLexer lexer(source, symbols);
+                Parser parser(lexer, tree);
+                tree.setASTRoot(parser.parse());
+            });
+    if (tree.getASTRoot() == nullptr)
+    {
+        throw runtime_error("Syntax Error: empty program");
+    }
+
+    measure(totals[STANDARDIZE], [&]
+            {
+                tree.generate();
+                Resolver::resolveTree(tree.getSTRoot());
+            });
+
+    CSE machine;
+    measure(totals[COMPILE], [&]
+            { machine.createCS(tree.getSTRoot(), symbols); });
+
+    BytecodeProgram program;
+    measure(totals[BYTECODE_COMPILE], [&]
+            { program = BytecodeCompiler().compile(tree.getSTRoot(), symbols); });
+    tree.release();
+
+    // output is kept in memory and dropped, so printing costs no I/O
+    string output;
+    OutputSink sink;
+    sink.setTarget(output);
+
+    machine.setOutput(sink);
+    measure(totals[EVALUATE], [&]
+            { machine.evaluate(); });
+
+    output.clear();
+    CSE bytecodeMachine;
+    bytecodeMachine.setOutput(sink);
+    measure(totals[BYTECODE_EVALUATE], [&]
+            { bytecodeMachine.execute(program); });
+}
+
+// peak resident set of this process in KiB, or -1 where it is not known
+static long peakRssKb()
+{
+#ifndef _WIN32
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0)
+    {
+        return usage.ru_maxrss;
+    }
+#endif
+    return -1;
+}
+
+// JSON string literal
+static string quoted(const string &text)
+{
+    string result = "\"";
+    for (char c : text)
+    {
+        if (c == '"' || c == '\\')
+        {
+            result += '\\';
+        }
+        result += c;
+    }
+    return result + "\"";
+}
+
+// run a benchmark until minMillis have passed and print its phases
+static void runBenchmark(const Benchmark &benchmark, double minMillis)
+{
+    PhaseTotals totals[PHASE_COUNT];
+    long long iterations = 0;
+    Clock::time_point start = Clock::now();
+    string error;
+
+    try
+    {
+        do
+        {
+            runPipeline(benchmark.source, totals);
+            iterations++;
+        } while (chrono::duration<double, milli>(Clock::now() - start).count() < minMillis && iterations < 1000);
+    }
+    catch (const exception &exception)
+    {
+        error = exception.what();
+    }
+
+    string prefix = "{\"benchmark\": " + quoted(benchmark.name) + ", \"size\": " + to_string(benchmark.size);
+    if (!error.empty())
+    {
+        cout << prefix << ", \"error\": " << quoted(error) << "}\n";
+        return;
+    }
+
+    long rss = peakRssKb();
+    for (int phase = 0; phase < PHASE_COUNT; phase++)
+    {
+        double nanosPerOp = totals[phase].nanos / iterations;
+        char line[256];
+        int length = snprintf(line, sizeof(line),
+                              ", \"phase\": \"%s\", \"iterations\": %lld, \"ns_per_op\": %.0f, \"allocs_per_op\": %.1f, "
+                              "\"bytes_per_op\": %.0f, \"peak_rss_kb\": %ld",
+                              phaseNames[phase], iterations, nanosPerOp,
+                              static_cast<double>(totals[phase].allocations) / iterations,
+                              static_cast<double>(totals[phase].bytes) / iterations, rss);
+        // parse throughput over the source, lexing included as in myrpal -timing
+        if (phase == PARSE && nanosPerOp > 0)
+        {
+            snprintf(line + length, sizeof(line) - length, ", \"mb_per_s\": %.1f",
+                     benchmark.source.size() * 1e3 / nanosPerOp);
+        }
+        cout << prefix << line << "}\n";
+    }
+}
+
+// run a benchmark in a child process; a crash or a timeout is reported as an error
+static void runIsolated(const Benchmark &benchmark, double minMillis)
+{
+    cout.flush();
+#ifndef _WIN32
+    pid_t child = fork();
+    if (child == 0)
+    {
+        alarm(120);
+        runBenchmark(benchmark, minMillis);
+        cout.flush();
+        _exit(0);
+    }
+
+    int status = 0;
+    if (child > 0 && waitpid(child, &status, 0) == child && WIFEXITED(status) && WEXITSTATUS(status) == 0)
+    {
+        return;
+    }
+    string reason = child < 0 ? "fork failed" : WIFSIGNALED(status) ? "signal " + to_string(WTERMSIG(status)) : "exit status " + to_string(WEXITSTATUS(status));
+    cout << "{\"benchmark\": " << quoted(benchmark.name) << ", \"size\": " << benchmark.size
+         << ", \"error\": " << quoted(reason) << "}" << endl;
+#else
+    runBenchmark(benchmark, minMillis);
+#endif
+}
+
+// Synthetic programs, each scaling one dimension with n
+
+// n nested calls of a rec function
+static string deepRecursion(long long n)
+{
+    return "let rec f n = n eq 0 -> 0 | 1 + f (n - 1) in Print (f " + to_string(n) + ")";
+}
+
+// a tuple of n elements built with aug
+static string largeTuple(long long n)
+{
+    return "let rec build n = n eq 0 -> nil | build (n - 1) aug n in Print (Order (build " + to_string(n) + "))";
+}
+
+// a string built by n Conc calls
+static string concChain(long long n)
+{
+    return "let rec c n = n eq 0 -> '' | Conc (c (n - 1)) 'ab' in Print (c " + to_string(n) + ")";
+}
+
+// one let binding n variables with and
+static string wideLetAnd(long long n)
+{
+    ostringstream source;
+    source << "let ";
+    for (long long i = 0; i < n; i++)
+    {
+        source << (i > 0 ? " and " : "") << "x" << i << " = " << i;
+    }
+    source << " in Print (Order (";
+    for (long long i = 0; i < n; i++)
+    {
+        source << (i > 0 ? ", " : "") << "x" << i;
+    }
+    source << "))";
+    return source.str();
+}
+
+// n nested lets, each scope inside the last; every phase must walk the tree without recursing
+static string deepLet(long long n)
+{
+    ostringstream source;
+    for (long long i = 0; i < n; i++)
+    {
+        source << "let x" << i << " = " << i << " in ";
+    }
+    source << "Print x0";
+    return source.str();
+}
+
+// Usage: rpalbench [-min-ms N] [-sizes n1,n2,...] [program_file_or_directory ...]
+int main(int argc, char *argv[])
+{
+    double minMillis = 200;
+    vector<long long> sizes = {1000, 10000, 100000};
+    vector<string> inputs;
+    HeapCounter::enabled = true;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        string arg(argv[i]);
+        if (arg == "-min-ms" && i + 1 < argc)
+        {
+            minMillis = stod(argv[++i]);
+        }
+        else if (arg == "-sizes" && i + 1 < argc)
+        {
+            sizes.clear();
+            stringstream list(argv[++i]);
+            string size;
+            while (getline(list, size, ','))
+            {
+                sizes.push_back(stoll(size));
+            }
+        }
+        else
+        {
+            inputs.push_back(arg);
+        }
+    }
+
+    vector<Benchmark> benchmarks;
+    for (const string &input : inputs)
+    {
+        vector<string> paths = filesystem::is_directory(input) ? batchPrograms(input) : vector<string>{input};
+        for (const string &path : paths)
+        {
+            SourceFile file;
+            if (!file.open(path))
+            {
+                cerr << "Unable to open file: " << path << endl;
+                return 1;
+            }
+            string source(file.view());
+            benchmarks.push_back({path, static_cast<long long>(source.size()), source});
+        }
+    }
+
+    const pair<const char *, string (*)(long long)> generators[] = {
+        {"deep_rec", deepRecursion},
+        {"large_tuple", largeTuple},
+        {"conc_chain", concChain},
+        {"wide_let_and", wideLetAnd},
+        {"deep_let", deepLet}};
+    for (const auto &generator : generators)
+    {
+        for (long long size : sizes)
+        {
+            benchmarks.push_back({generator.first, size, generator.second(size)});
+        }
+    }
+
+    for (const Benchmark &benchmark : benchmarks)
+    {
+        runIsolated(benchmark, minMillis);
+    }
+    return 0;
+}
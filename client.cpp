@@ -0,0 +1,74 @@
+#include <iostream>
+#include <string>
+#include "Server.h"
+#include "SourceFile.h"
+
+using namespace std;
+
+// Client for a myrpal server listening on a Unix domain socket.
+// Sends each program in turn over one connection and prints what it printed, ended by a
+// newline; "-" or no file sends stdin. Given several programs, each output is headed by
+// "==> file <==" as in --batch. Exits with 1 when any program failed.
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        cout << "ERROR: Usage: rpalc socket_path [input_file ...]" << endl;
+        return 1;
+    }
+
+#ifdef _WIN32
+    cout << "ERROR: Unix domain sockets are not supported on this platform" << endl;
+    return 1;
+#else
+    int fd = connectSocket(argv[1]);
+    if (fd < 0)
+    {
+        cout << "Unable to connect to " << argv[1] << endl;
+        return 1;
+    }
+
+    SocketStreamBuf buffer(fd);
+    istream in(&buffer);
+    ostream out(&buffer);
+
+    int status = 0;
+    int first = 2;
+    int last = argc > 2 ? argc : 3; // no file means stdin
+    for (int i = first; i < last; ++i)
+    {
+        string filename = i < argc ? argv[i] : "-";
+        SourceFile source;
+        if (!source.open(filename))
+        {
+            cout << "Unable to open file: " << filename << endl;
+            status = 1;
+            continue;
+        }
+
+        string header;
+        string output;
+        writeFrame(out, "", source.view());
+        // replies are as long as the program's output
+        if (!readFrame(in, header, output, SIZE_MAX))
+        {
+            cout << "Server closed the connection" << endl;
+            return 1;
+        }
+        if (last - first > 1)
+        {
+            cout << "==> " << filename << " <==\n";
+        }
+        cout << output;
+        if (!output.empty() && output.back() != '\n')
+        {
+            cout << '\n';
+        }
+        if (header.compare(0, 3, "ok ") != 0)
+        {
+            status = 1;
+        }
+    }
+    return status;
+#endif
+}
@@ -0,0 +1,224 @@
+#include "Interpreter.h"
+#include <chrono>
+#include <stdexcept>
+#include "LexicalAnalyzer.h"
+#include "Parser.h"
+#include "Tree.h"
+#include "Resolver.h"
+#include "Bytecode.h"
+#include "CSEMachine.h"
+#include "ProgramCache.h"
+
+using namespace std;
+
+using Clock = chrono::steady_clock;
+
+// milliseconds since start; start moves to now
+static double lapMillis(Clock::time_point &start)
+{
+    Clock::time_point now = Clock::now();
+    double millis = chrono::duration<double, milli>(now - start).count();
+    start = now;
+    return millis;
+}
+
+// nodes reachable from root
+static long long countNodes(TreeNode *root)
+{
+    long long count = 0;
+    vector<TreeNode *> pending;
+    if (root != nullptr)
+    {
+        pending.push_back(root);
+    }
+    while (!pending.empty())
+    {
+        TreeNode *node = pending.back();
+        pending.pop_back();
+        count++;
+        for (TreeNode *child : node->getChildren())
+        {
+            pending.push_back(child);
+        }
+    }
+    return count;
+}
+
+Interpreter::Interpreter(bool useBytecode)
+    : symbols(make_unique<SymbolTable>()), tree(make_unique<Tree>(*symbols)), useBytecode(useBytecode)
+{
+}
+
+Interpreter::~Interpreter() = default;
+
+const char *Interpreter::version()
+{
+    // every build gets its own version, so a rebuilt interpreter never runs programs compiled by another
+    static const string text = "bytecode " + to_string(BYTECODE_VERSION) + " built " __DATE__ " " __TIME__;
+    return text.c_str();
+}
+
+void Interpreter::reset()
+{
+    cse.reset();
+    program.reset();
+    tree->release();
+    symbols->reset();
+    runStats = RunStats();
+}
+
+TreeNode *Interpreter::parse(string_view source)
+{
+    reset();
+    runStats.sourceBytes = source.size();
+
+    Clock::time_point phaseStart = Clock::now();
+    if (detailedStats)
+    {
+        CustomLexer lexer(source, *symbols);
+        while (lexer.getNextToken().type != tokenType::END_OF_FILE)
+        {
+            runStats.tokens++;
+        }
+        runStats.lexMillis = lapMillis(phaseStart);
+    }
+
+    CustomLexer lexer(source, *symbols);
+    Parser parser(lexer, *tree);
+    tree->setASTRoot(parser.parse());
+    runStats.parseMillis = lapMillis(phaseStart);
+
+    if (detailedStats)
+    {
+        runStats.astNodes = countNodes(tree->getASTRoot());
+    }
+    return tree->getASTRoot();
+}
+
+void Interpreter::load(string_view source)
+{
+    sourceMap.reset(source);
+    bool compile = (useBytecode || cache != nullptr) && profiler == nullptr;
+    if (cache != nullptr && profiler == nullptr)
+    {
+        reset();
+        runStats.sourceBytes = source.size();
+
+        Clock::time_point phaseStart = Clock::now();
+        program = cache->find(source);
+        if (program != nullptr)
+        {
+            cse = make_unique<CSE>();
+            cse->setSourceMap(&sourceMap);
+            runStats.cacheHit = true;
+            runStats.controlStructures = program->blocks.size() - 1;
+            runStats.compileMillis = lapMillis(phaseStart);
+            return;
+        }
+    }
+
+    parse(source);
+
+    Clock::time_point phaseStart = Clock::now();
+    if (tree->getASTRoot() == nullptr)
+    {
+        throw runtime_error("Syntax Error: empty program");
+    }
+
+    tree->generate();
+    TreeNode *st_root = tree->getSTRoot();
+    Resolver::resolveTree(st_root);
+    runStats.standardizeMillis = lapMillis(phaseStart);
+
+    if (detailedStats)
+    {
+        // counted outside the timed phases
+        runStats.stNodes = countNodes(st_root);
+        runStats.treeBytes = tree->getArena().bytesAllocated();
+        phaseStart = Clock::now();
+    }
+
+    cse = make_unique<CSE>();
+    cse->setSourceMap(&sourceMap);
+    if (compile)
+    {
+        // compiled control structures run on the threaded bytecode machine
+        program = make_unique<BytecodeProgram>(BytecodeCompiler().compile(st_root, *symbols));
+    }
+    else
+    {
+        cse->createCS(st_root, *symbols);
+    }
+    // the eta block of the bytecode is the machine's own, like the one evaluate adds
+    runStats.controlStructures = program != nullptr ? program->blocks.size() - 1 : cse->getControlStructureCount();
+    tree->release(); // the machine owns everything it needs
+
+    if (cache != nullptr && program != nullptr)
+    {
+        cache->store(source, *program);
+    }
+    runStats.compileMillis = lapMillis(phaseStart);
+}
+
+void Interpreter::execute(ostream &out)
+{
+    output.setTarget(out);
+    execute();
+}
+
+void Interpreter::execute(string &out)
+{
+    output.setTarget(out);
+    execute();
+}
+
+void Interpreter::execute()
+{
+    if (cse == nullptr)
+    {
+        throw logic_error("No program loaded");
+    }
+
+    Clock::time_point phaseStart = Clock::now();
+    cse->setOutput(output);
+    cse->setTrackDepth(detailedStats);
+    cse->setProfiler(profiler);
+    try
+    {
+        if (program != nullptr)
+        {
+            cse->execute(*program);
+        }
+        else
+        {
+            cse->evaluate();
+        }
+    }
+    catch (...)
+    {
+        // what was printed before the error still reaches the target
+        output.flush();
+        throw;
+    }
+    output.flush();
+    runStats.evaluateMillis = lapMillis(phaseStart);
+
+    runStats.createdEnvs = cse->getCreatedEnvs();
+    runStats.peakEnvs = cse->getPeakEnvs();
+    runStats.liveEnvs = cse->getLiveEnvs();
+    runStats.gammas = cse->getGammas();
+    runStats.peakStack = cse->getPeakStack();
+    runStats.peakControl = cse->getPeakControl();
+
+    // a machine runs once; its memory is released now rather than at the next load
+    cse.reset();
+    program.reset();
+}
+
+string Interpreter::run(string_view source)
+{
+    load(source);
+    string out;
+    execute(out);
+    return out;
+}
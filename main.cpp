@@ -1,35 +1,43 @@
+#include <cstdlib>
+#include <functional>
 #include <iostream>
+#include <mutex>
 #include <string>
 #include <fstream>
-#include <unordered_map>
 #include <filesystem>
-#include "Parser.h"
 #include "Token.h"
-#include "CSEMachine.h"
-#include "BOP/binaryOP.h"
-#include "Tree.h"
+#include "Batch.h"
+#include "HeapCounter.h"
+#include "Interpreter.h"
+#include "ProgramCache.h"
+#include "Profiler.h"
+#include "Server.h"
+#include "SourceFile.h"
 
 #include "TreeNode.h"
 
 using namespace std;
 namespace fs = std::filesystem; // Namespace alias for filesystem
 
-// Map the enum values
-unordered_map<tokenType, string> token_typeNames = {
-    {tokenType::IDENTIFIER, "IDENTIFIER"},
-    {tokenType::INTEGER, "INTEGER"},
-    {tokenType::STRING, "STRING"},
-    {tokenType::OPERATOR, "OPERATOR"},
-    {tokenType::DELIMITER, "DELIMITER"},
-    {tokenType::KEYWORD, "KEYWORD"},
-    {tokenType::END_OF_FILE, "END_OF_FILE"}};
-
-// Get token name
+// Get token name; a switch rather than a global map, so startup builds no table
 string gettoken_typeName(tokenType type)
 {
-    if (token_typeNames.count(type) > 0)
+    switch (type)
     {
-        return token_typeNames[type];
+    case tokenType::IDENTIFIER:
+        return "IDENTIFIER";
+    case tokenType::INTEGER:
+        return "INTEGER";
+    case tokenType::STRING:
+        return "STRING";
+    case tokenType::OPERATOR:
+        return "OPERATOR";
+    case tokenType::DELIMITER:
+        return "DELIMITER";
+    case tokenType::KEYWORD:
+        return "KEYWORD";
+    case tokenType::END_OF_FILE:
+        return "END_OF_FILE";
     }
     return "UNKNOWN";
 }
@@ -66,7 +74,7 @@ int generateDotFileHelper(TreeNode *node, ofstream &file, int parent = -1, int n
     string fillColor = (node->getValue() == " " || node->getValue().empty()) ? "#DDDDDD" : "#EEEEEE"; // Change fill color to light gray or silver
 
     // Escape label characters if necessary
-    string escapedLabel = node->getLabel();
+    string escapedLabel(node->getLabel());
     size_t pos1 = escapedLabel.find('&');
     while (pos1 != string::npos)
     {
@@ -83,7 +91,7 @@ int generateDotFileHelper(TreeNode *node, ofstream &file, int parent = -1, int n
 
     // Prepare label and value strings for the dot file
     string labelStr = (escapedLabel.empty()) ? "&nbsp;" : escapedLabel;
-    string valueStr = (node->getValue().empty()) ? "&nbsp;" : node->getValue();
+    string valueStr = (node->getValue().empty()) ? "&nbsp;" : string(node->getValue());
 
     size_t pos2 = valueStr.find('\n');
     while (pos2 != string::npos)
@@ -142,28 +150,215 @@ void printAST(TreeNode *node, int depth = 0)
     }
 }
 
+// the compiled-program cache asked for by -cache or -cachestats, or nullptr
+unique_ptr<ProgramCache> openCache(bool useCache)
+{
+    return useCache ? make_unique<ProgramCache>(ProgramCache::defaultDirectory(), Interpreter::version()) : nullptr;
+}
+
+// report cache lookups on stderr
+void printCacheStats(const ProgramCache &cache)
+{
+    cerr << "Cache: " << cache.getHits() << " hits, " << cache.getMisses() << " misses, " << cache.getStores()
+         << " stored in " << cache.getDirectory().string() << endl;
+}
+
+// report the phases and counters of a run on stderr, one "name: value" per line
+void printRunStats(const RunStats &stats, long long heapBytes)
+{
+    cerr << "Stats:\n"
+         << "  lex: " << stats.lexMillis << " ms, " << stats.tokens << " tokens\n"
+         << "  parse: " << stats.parseMillis << " ms (including lexing), " << stats.astNodes << " AST nodes\n"
+         << "  standardize: " << stats.standardizeMillis << " ms, " << stats.stNodes << " ST nodes\n"
+         << "  compile: " << stats.compileMillis << " ms, " << stats.controlStructures << " control structures"
+         << (stats.cacheHit ? " (from cache)" : "") << "\n"
+         << "  evaluate: " << stats.evaluateMillis << " ms, " << stats.gammas << " gamma applications\n"
+         << "  environments: " << stats.createdEnvs << " created, " << stats.peakEnvs << " peak live\n"
+         << "  peak depth: stack " << stats.peakStack << ", control " << stats.peakControl << "\n"
+         << "  allocated: " << stats.treeBytes << " bytes of tree, " << heapBytes << " bytes of heap" << endl;
+}
+
+// Run every program of a directory or list file; outputs go to stdout in order, timings to stderr
+int runBatchMode(int argc, char *argv[])
+{
+    bool useBytecode = false;
+    bool useCache = false;
+    bool cacheStats = false;
+    size_t workers = thread::hardware_concurrency();
+
+    for (int i = 3; i < argc; ++i)
+    {
+        string arg(argv[i]);
+        if (arg == "-bytecode")
+        {
+            useBytecode = true;
+        }
+        else if (arg == "-jobs" && i + 1 < argc)
+        {
+            workers = stoul(argv[++i]);
+        }
+        else if (arg == "-cache" || arg == "-cachestats")
+        {
+            useCache = true;
+            cacheStats = cacheStats || arg == "-cachestats";
+        }
+    }
+
+    vector<string> paths;
+    try
+    {
+        paths = batchPrograms(argv[2]);
+    }
+    catch (const exception &error)
+    {
+        cout << error.what() << endl;
+        return 1;
+    }
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    unique_ptr<ProgramCache> cache = openCache(useCache);
+    vector<BatchResult> results = runBatch(paths, workers, useBytecode, cache.get());
+    double wallMillis = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+    int failures = 0;
+    double totalMillis = 0;
+    for (const BatchResult &result : results)
+    {
+        cout << "==> " << result.path << " <==\n"
+             << result.output;
+        if (!result.output.empty() && result.output.back() != '\n')
+        {
+            cout << '\n';
+        }
+        cerr << result.path << ": " << result.millis << " ms" << (result.failed ? " (failed)" : "") << '\n';
+        failures += result.failed;
+        totalMillis += result.millis;
+    }
+    cout << flush;
+    cerr << "Batch: " << results.size() << " programs, " << failures << " failed, " << wallMillis << " ms wall, "
+         << totalMillis << " ms in programs" << endl;
+    if (cacheStats)
+    {
+        printCacheStats(*cache);
+    }
+
+    return failures == 0 ? 0 : 1;
+}
+
+// Answer framed programs on stdin, or on a Unix domain socket when a path is given
+int runServeMode(int argc, char *argv[])
+{
+    bool useBytecode = false;
+    bool useCache = false;
+    bool cacheStats = false;
+    string socketPath;
+
+    for (int i = 2; i < argc; ++i)
+    {
+        string arg(argv[i]);
+        if (arg == "-bytecode")
+        {
+            useBytecode = true;
+        }
+        else if (arg == "-cache" || arg == "-cachestats")
+        {
+            useCache = true;
+            cacheStats = cacheStats || arg == "-cachestats";
+        }
+        else if (arg != "-")
+        {
+            socketPath = arg;
+        }
+    }
+
+    unique_ptr<ProgramCache> cache = openCache(useCache);
+    if (socketPath.empty())
+    {
+        ios::sync_with_stdio(false);
+        Interpreter interpreter(useBytecode);
+        interpreter.setCache(cache.get());
+        serveStream(interpreter, cin, cout);
+        if (cacheStats)
+        {
+            printCacheStats(*cache);
+        }
+        return 0;
+    }
+
+#ifdef _WIN32
+    cout << "ERROR: Unix domain sockets are not supported on this platform" << endl;
+    return 1;
+#else
+    try
+    {
+        // the counts cover every connection so far, reported as each one closes
+        function<void()> closed;
+        if (cacheStats)
+        {
+            closed = [&cache]
+            {
+                static mutex reportLock;
+                lock_guard<mutex> lock(reportLock);
+                printCacheStats(*cache);
+            };
+        }
+        serveSocket(socketPath, useBytecode, cache.get(), closed);
+    }
+    catch (const exception &error)
+    {
+        cout << error.what() << endl;
+    }
+    return 1;
+#endif
+}
+
 int main(int argc, char *argv[])
 {
     if (argc < 2 || string(argv[1]) == "-ast") // check user want to visualize AST or not
     {
-        cout << "ERROR: Usage: .\\rpal20 input_file [-ast=VALUE]\n"
+        cout << "ERROR: Usage: .\\rpal20 input_file [-ast] [-bytecode] [-envstats] [-timing] [--stats] [-cache] [-cachestats]\n"
+             << "                     [--profile output_file] [-profile-interval N]\n"
+             << "       .\\rpal20 --batch directory_or_list_file [-bytecode] [-jobs N] [-cache] [-cachestats]\n"
+             << "       .\\rpal20 --serve [socket_path] [-bytecode] [-cache] [-cachestats]\n"
              << endl;
         return 1;
     }
 
+    if (string(argv[1]) == "--batch")
+    {
+        if (argc < 3)
+        {
+            cout << "ERROR: --batch needs a directory or a list file" << endl;
+            return 1;
+        }
+        return runBatchMode(argc, argv);
+    }
+
+    if (string(argv[1]) == "--serve")
+    {
+        return runServeMode(argc, argv);
+    }
+
+    // the source is mapped, not copied; "-" reads the program from stdin
     string filename = argv[1];
-    ifstream file(filename);
-    if (!file.is_open())
+    SourceFile source;
+    if (!source.open(filename))
     {
         cout << "Unable to open file: " << filename << endl;
         return 1;
     }
 
-    string input((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
-
     string visualizeArg;
     bool visualizeAst = false;
     bool visualizeSt = false;
+    bool useBytecode = false;
+    bool envStats = false;
+    bool timing = false;
+    bool useCache = false;
+    bool cacheStats = false;
+    bool runStats = false;
+    string profilePath;
+    long long profileInterval = 1000;
 
     for (int i = 2; i < argc; ++i)
     {
@@ -172,16 +367,46 @@ int main(int argc, char *argv[])
         {
             visualizeAst = true;
         }
+        else if (arg == "-bytecode")
+        {
+            useBytecode = true;
+        }
+        else if (arg == "-envstats")
+        {
+            envStats = true;
+        }
+        else if (arg == "-timing")
+        {
+            timing = true;
+        }
+        else if (arg == "-cache" || arg == "-cachestats")
+        {
+            useCache = true;
+            cacheStats = cacheStats || arg == "-cachestats";
+        }
+        else if (arg == "--stats")
+        {
+            runStats = true;
+        }
+        else if (arg == "--profile" && i + 1 < argc)
+        {
+            profilePath = argv[++i];
+        }
+        else if (arg == "-profile-interval" && i + 1 < argc)
+        {
+            profileInterval = stoll(argv[++i]);
+        }
     }
 
-    if (!isGraphvizInstalled() && (visualizeAst || visualizeSt))
+    // probe for dot only when a picture was asked for; it spawns a shell
+    if ((visualizeAst || visualizeSt) && !isGraphvizInstalled())
     {
         displayGraphvizWarning();
         visualizeAst = false;
         visualizeSt = false;
     }
 
-    if (isGraphvizInstalled() && (visualizeSt || visualizeAst))
+    if (visualizeSt || visualizeAst)
     {
         if (!fs::exists("vizualise"))
         {
@@ -193,16 +418,11 @@ int main(int argc, char *argv[])
         }
     }
 
-    CustomLexer lexer(input);
-    TokenController &tokenController = TokenController::getInstance();
-    tokenController.setLexer(lexer);
-
-    Parser::parse();
-    TokenController::destroyInstance();
-    TreeNode *root = Tree::getInstance().getASTRoot();
+    Interpreter interpreter(useBytecode);
 
     if (visualizeAst)
     {
+        TreeNode *root = interpreter.parse(source.view());
         generateDotFile(root, "ast.dot");
         string dotFilePath = fs::absolute(fs::path("vizualise") / "ast.dot").string();
         string outputFilePath = fs::absolute(fs::path("vizualise") / "ast.png").string();
@@ -215,13 +435,62 @@ int main(int argc, char *argv[])
         exit(0);
     }
 
-    Tree::generate();
-    TreeNode *st_root = Tree::getInstance().getSTRoot();
+    unique_ptr<ProgramCache> cache = openCache(useCache);
+    interpreter.setCache(cache.get());
+    interpreter.setDetailedStats(runStats);
+    // heap bytes are counted only under --stats
+    HeapCounter::enabled = runStats;
 
-    CSE cse = CSE();
-    cse.createCS(Tree::getInstance().getSTRoot());
+    // sampled on the CSE machine, which knows which function each control structure belongs to
+    Profiler profiler(profileInterval);
+    if (!profilePath.empty())
+    {
+        interpreter.setProfiler(&profiler);
+    }
+    interpreter.load(source.view());
     cout << "Output of the above program is:" << endl;
-    cse.evaluate();
+    interpreter.execute(cout);
+
+    const RunStats &stats = interpreter.stats();
+    if (timing)
+    {
+        // parse throughput covers lexing, which runs on demand inside the parser
+        double parseMBPerSecond = stats.parseMillis > 0 ? stats.sourceBytes / 1e3 / stats.parseMillis : 0;
+        cerr << "Timing: parse " << stats.parseMillis << " ms (" << parseMBPerSecond << " MB/s), standardize "
+             << stats.standardizeMillis << " ms, compile " << stats.compileMillis << " ms, evaluate "
+             << stats.evaluateMillis << " ms" << endl;
+    }
+
+    if (envStats)
+    {
+        // kept off stdout so program output is unchanged
+        cerr << "Environments: created " << stats.createdEnvs << ", peak live " << stats.peakEnvs << ", live "
+             << stats.liveEnvs << endl;
+    }
+
+    if (runStats)
+    {
+        HeapCounter::enabled = false;
+        printRunStats(stats, HeapCounter::bytes);
+    }
+
+    if (cacheStats)
+    {
+        printCacheStats(*cache);
+    }
+
+    if (!profilePath.empty())
+    {
+        ofstream profile(profilePath);
+        profiler.write(profile);
+        if (!profile)
+        {
+            cerr << "Unable to write profile: " << profilePath << endl;
+            return 1;
+        }
+        cerr << "Profile: " << profiler.getSamples() << " samples every " << profileInterval << " steps written to "
+             << profilePath << endl;
+    }
 
     return 0;
 }
@@ -1,375 +1,320 @@
 #include "TreeNode.h"
 #include "Tree.h"
 #include <stdexcept>
+#include <vector>
 using namespace std;
 
-Tree *Tree::tree = new Tree(); // Initialize the singleton instance of the tree
-
-// Function to generate syntax tree
-void generateST(TreeNode *currentNode, TreeNode *parentNode)
+// Build lambda(V_first, lambda(V_first+1, ... body)) over the children [first, last) of node;
+// the lambdas take the source offset of node
+static TreeNode *curryLambdas(Tree &tree, TreeNode *node, int first, int last, TreeNode *body)
 {
-    if (currentNode == nullptr)
+    TreeNode *inner = body;
+    for (int i = last - 1; i >= first; i--)
     {
-        return; // Exit if the current node is nullptr
+        TreeNode *lambda_node = tree.internalNode(NodeKind::LAMBDA, node->getOffset());
+        lambda_node->addChild(node->getChildren()[i]);
+        lambda_node->addChild(inner);
+        inner = lambda_node;
     }
+    return inner;
+}
 
-    if (currentNode->getNumChildren() != 0)
+// let and where: gamma(lambda(X, P), E), reusing the let/where node as the gamma
+// and the = node as the lambda
+static TreeNode *standardizeLetWhere(TreeNode *currentNode, const char *name)
+{
+    if (currentNode->getNumChildren() != 2)
     {
-        vector<TreeNode *> children = currentNode->getChildren(); // Get the children of the current node
-        for (TreeNode *child : children)
-        {
-            generateST(child, currentNode); // Generate the syntax tree for each child
-            currentNode->removeChild(0);    // Remove the processed child from the current node
-        }
+        throw runtime_error(string("Error: ") + name + " node must have 2 children.");
     }
 
-    TreeNode *root_node; // Assign the current node as the root node of the syntax tree
+    NodeSpan children = currentNode->getChildren();
+    TreeNode *eq_node;
+    TreeNode *p_node;
 
-    // Binary operators
-    static vector<string> binaryOperators = {"+", "-", "*", "/", "**", "gr", "ge", "ls", "le", "aug", "or", "&", "eq", "ne"};
+    // The "=" node may be either child
+    if (children[0]->getKind() == NodeKind::EQUALS)
+    {
+        eq_node = children[0];
+        p_node = children[1];
+    }
+    else if (children[1]->getKind() == NodeKind::EQUALS)
+    {
+        eq_node = children[1];
+        p_node = children[0];
+    }
+    else
+    {
+        throw runtime_error(string("Error: ") + name + " node does not have an = node as a child");
+    }
 
-    if (currentNode->getLabel() == "let")
+    if (eq_node->getNumChildren() != 2)
     {
-        if (currentNode->getNumChildren() == 2)
-        {
-            vector<TreeNode *> children = currentNode->getChildren();
+        throw runtime_error("Error: = node must only have 2 children.");
+    }
 
-            TreeNode *eq_node;
-            TreeNode *p_node;
+    TreeNode *expr_node = eq_node->getChildren()[1];
 
-            // If the first child is the "=" node
-            if (children[0]->getLabel() == "=")
-            {
-                eq_node = children[0];
-                p_node = children[1];
-            }
-            // If the second child is the "=" node
-            else if (children[1]->getLabel() == "=")
-            {
-                eq_node = children[1];
-                p_node = children[0];
-            }
-            // Throw an error if neither child is "=" node
-            else
-            {
-                throw runtime_error("Error: let node does not have an = node as a child");
-            }
+    eq_node->setKind(NodeKind::LAMBDA);
+    eq_node->setChild(1, p_node);
 
-            if (eq_node->getNumChildren() == 2)
-            {
-                TreeNode *lambda_node = new InternalNode("lambda");
-                TreeNode *gamma_node = new InternalNode("gamma");
+    currentNode->setKind(NodeKind::GAMMA);
+    currentNode->setChild(0, eq_node);
+    currentNode->setChild(1, expr_node);
+    return currentNode;
+}
 
-                TreeNode *var_node = eq_node->getChildren()[0];
-                TreeNode *expr_node = eq_node->getChildren()[1];
+// Standardize one node whose children are already standardized.
+// Nodes are rewritten in place where the shape allows; returns the node that replaces it.
+// New nodes take the source offset of the node they are built from.
+static TreeNode *standardizeNode(Tree &tree, TreeNode *currentNode)
+{
+    switch (currentNode->getKind())
+    {
+    case NodeKind::LET:
+        return standardizeLetWhere(currentNode, "let");
+
+    case NodeKind::WHERE:
+        return standardizeLetWhere(currentNode, "where");
+
+    case NodeKind::FCN_FORM:
+    {
+        // fcn_form(P, V1 .. Vn, E) => =(P, lambda(V1, ... lambda(Vn, E)))
+        int n = currentNode->getNumChildren();
+        if (n <= 2)
+        {
+            throw runtime_error("Error: fcn_form node must have more than 2 children.");
+        }
 
-                lambda_node->addChild(var_node);
-                lambda_node->addChild(p_node);
+        TreeNode *lambdas = curryLambdas(tree, currentNode, 1, n - 1, currentNode->getChildren()[n - 1]);
 
-                gamma_node->addChild(lambda_node);
-                gamma_node->addChild(expr_node);
+        currentNode->setKind(NodeKind::EQUALS);
+        currentNode->setChild(1, lambdas);
+        currentNode->truncateChildren(2);
+        return currentNode;
+    }
 
-                root_node = gamma_node; // Assign gamma_node as the new root node
-            }
-            else
-            {
-                throw runtime_error("Error: = node must only have 2 children.");
-            }
+    case NodeKind::LAMBDA:
+    {
+        // lambda(V1 .. Vn, E) => lambda(V1, ... lambda(Vn, E)); tuple binders stay as they are
+        int n = currentNode->getNumChildren();
+        if (n < 2)
+        {
+            throw runtime_error("Error: lambda node must have at least 2 children.");
         }
-        else
+        if (currentNode->getChildren()[0]->getKind() == NodeKind::COMMA ||
+            currentNode->getChildren()[1]->getKind() == NodeKind::COMMA)
         {
-            throw runtime_error("Error: let node must have 2 children.");
+            return currentNode;
         }
+
+        if (n > 2)
+        {
+            currentNode->setChild(1, curryLambdas(tree, currentNode, 1, n - 1, currentNode->getChildren()[n - 1]));
+            currentNode->truncateChildren(2);
+        }
+        return currentNode;
     }
-    else if (currentNode->getLabel() == "where")
+
+    case NodeKind::WITHIN:
     {
-        if (currentNode->getNumChildren() == 2)
+        // within(=(X1, E1), =(X2, E2)) => =(X2, gamma(lambda(X1, E2), E1))
+        if (currentNode->getNumChildren() != 2)
         {
-            vector<TreeNode *> children = currentNode->getChildren();
-
-            TreeNode *eq_node;
-            TreeNode *p_node;
+            throw runtime_error("Error: within node must have 2 children.");
+        }
 
-            // If the first child is the "=" node
-            if (children[0]->getLabel() == "=")
-            {
-                eq_node = children[0];
-                p_node = children[1];
-            }
-            // If the second child is the "=" node
-            else if (children[1]->getLabel() == "=")
+        for (TreeNode *child : currentNode->getChildren())
+        {
+            if (child->getKind() != NodeKind::EQUALS)
             {
-                eq_node = children[1];
-                p_node = children[0];
+                throw runtime_error("Error: within node must have an = node as a child");
             }
-            // Throw an error if neither child is the "=" node
-            else
+            else if (child->getNumChildren() != 2)
             {
-                throw runtime_error("Error: where node does not have an = node as a child");
+                throw runtime_error("Error: = node must have 2 children.");
             }
+        }
 
-            if (eq_node->getNumChildren() == 2)
-            {
-                TreeNode *lambda_node = new InternalNode("lambda");
-                TreeNode *gamma_node = new InternalNode("gamma");
-
-                TreeNode *var_node = eq_node->getChildren()[0];
-                TreeNode *expr_node = eq_node->getChildren()[1];
+        TreeNode *first_eq_node = currentNode->getChildren()[0];
+        TreeNode *second_eq_node = currentNode->getChildren()[1];
+        TreeNode *x2 = second_eq_node->getChildren()[0];
+        TreeNode *e1 = first_eq_node->getChildren()[1];
 
-                lambda_node->addChild(var_node);
-                lambda_node->addChild(p_node);
+        first_eq_node->setKind(NodeKind::LAMBDA);
+        first_eq_node->setChild(1, second_eq_node->getChildren()[1]);
 
-                gamma_node->addChild(lambda_node);
-                gamma_node->addChild(expr_node);
+        second_eq_node->setKind(NodeKind::GAMMA);
+        second_eq_node->setChild(0, first_eq_node);
+        second_eq_node->setChild(1, e1);
 
-                root_node = gamma_node; // Assign gamma_node as the new root node
-            }
-            else
-            {
-                throw runtime_error("Error: = node must only have 2 children.");
-            }
-        }
-        else
-        {
-            throw runtime_error("Error: where node must have 2 children.");
-        }
+        currentNode->setKind(NodeKind::EQUALS);
+        currentNode->setChild(0, x2);
+        currentNode->setChild(1, second_eq_node);
+        return currentNode;
     }
-    else if (currentNode->getLabel() == "fcn_form")
+
+    case NodeKind::AT:
     {
-        if (currentNode->getNumChildren() > 2)
+        // @(E1, N, E2) => gamma(gamma(N, E1), E2)
+        if (currentNode->getNumChildren() != 3)
         {
-            vector<TreeNode *> children = currentNode->getChildren();
-
-            TreeNode *fcn_name_node = children.front();
-            // Remove fcn_name_node from children
-            children.erase(children.begin());
-
-            TreeNode *expr_node = children.back();
-            // Remove expr_node from children
-            children.pop_back();
-
-            TreeNode *eq_node = new InternalNode("=");
-
-            eq_node->addChild(fcn_name_node);
-
-            TreeNode *prev_node = eq_node;
-            for (TreeNode *child : children)
-            {
-                TreeNode *lambda_node = new InternalNode("lambda");
-                lambda_node->addChild(child);
-                prev_node->addChild(lambda_node);
-                prev_node = lambda_node;
-            }
+            throw runtime_error("Error: @ node must have 3 children.");
+        }
 
-            prev_node->addChild(expr_node);
+        NodeSpan children = currentNode->getChildren();
+        TreeNode *inner_gamma_node = tree.internalNode(NodeKind::GAMMA, currentNode->getOffset());
+        inner_gamma_node->addChild(children[1]);
+        inner_gamma_node->addChild(children[0]);
 
-            root_node = eq_node; // Assign eq_node as the new root node
-        }
-        else
-        {
-            throw runtime_error("Error: fcn_form node must have more than 2 children.");
-        }
+        currentNode->setKind(NodeKind::GAMMA);
+        currentNode->setChild(0, inner_gamma_node);
+        currentNode->setChild(1, children[2]);
+        currentNode->truncateChildren(2);
+        return currentNode;
     }
-    else if (currentNode->getLabel() == "tau")
-    {
-        root_node = currentNode;
-    }
-    else if (currentNode->getLabel() == "lambda" && currentNode->getChildren()[0]->getLabel() != "," &&
-             currentNode->getChildren()[1]->getLabel() != ",")
+
+    case NodeKind::AND:
     {
-        if (currentNode->getNumChildren() >= 2)
+        // and(=(X1, E1) .. =(Xn, En)) => =(,(X1 .. Xn), tau(E1 .. En))
+        if (currentNode->getNumChildren() < 2)
         {
-            vector<TreeNode *> children = currentNode->getChildren();
-
-            TreeNode *expr_node = children.back();
-            // Remove expr_node from children
-            children.pop_back();
-
-            TreeNode *head_lambda_node = new InternalNode("lambda");
-
-            TreeNode *prev_node = head_lambda_node;
-            for (TreeNode *child : children)
-            {
-                TreeNode *lambda_node = new InternalNode("lambda");
-                lambda_node->addChild(child);
-                prev_node->addChild(lambda_node);
-                prev_node = lambda_node;
-            }
+            throw runtime_error("Error: and node must have at least 2 children.");
+        }
 
-            prev_node->addChild(expr_node);
+        TreeNode *comma_node = tree.internalNode(NodeKind::COMMA, currentNode->getOffset());
+        TreeNode *tau_node = tree.internalNode(NodeKind::TAU, currentNode->getOffset());
 
-            root_node = head_lambda_node->getChildren()[0];
-            head_lambda_node->getChildren().erase(head_lambda_node->getChildren().begin());
-            delete head_lambda_node;
-        }
-        else
+        for (TreeNode *child : currentNode->getChildren())
         {
-            throw runtime_error("Error: lambda node must have at least 2 children.");
+            comma_node->addChild(child->getChildren()[0]);
+            tau_node->addChild(child->getChildren()[1]);
         }
+
+        currentNode->setKind(NodeKind::EQUALS);
+        currentNode->setChild(0, comma_node);
+        currentNode->setChild(1, tau_node);
+        currentNode->truncateChildren(2);
+        return currentNode;
     }
-    else if (currentNode->getLabel() == "within")
+
+    case NodeKind::REC:
     {
-        if (currentNode->getNumChildren() == 2)
+        // rec(=(X, E)) => =(X, gamma(Y*, lambda(X, E)))
+        if (currentNode->getNumChildren() != 1)
         {
-            vector<TreeNode *> children = currentNode->getChildren();
-
-            // If each child is the "=" node and has exactly 2 children
-            for (TreeNode *child : children)
-            {
-                if (child->getLabel() != "=")
-                {
-                    throw runtime_error("Error: within node must have an = node as a child");
-                }
-                else if (child->getNumChildren() != 2)
-                {
-                    throw runtime_error("Error: = node must have 2 children.");
-                }
-            }
-
-            // Retrieve two "=" nodes
-            TreeNode *first_eq_node = children[0];
-            TreeNode *second_eq_node = children[1];
+            throw runtime_error("Error: rec node must have 1 child.");
+        }
 
-            // Make new nodes for constructing the modified syntax tree
-            TreeNode *new_eq_node = new InternalNode("=");
-            TreeNode *new_gamma_node = new InternalNode("gamma");
-            TreeNode *new_lambda_node = new InternalNode("lambda");
+        TreeNode *eq_node = currentNode->getChildren()[0];
+        TreeNode *var_node = eq_node->getChildren()[0];
 
-            // Modify the new_eq_node and new_gamma_node
-            new_eq_node->addChild(second_eq_node->getChildren()[0]);
-            new_eq_node->addChild(new_gamma_node);
+        eq_node->setKind(NodeKind::LAMBDA);
 
-            // Modify the new_gamma_node
-            new_gamma_node->addChild(new_lambda_node);
-            new_gamma_node->addChild(first_eq_node->getChildren()[1]);
+        TreeNode *gamma_node = tree.internalNode(NodeKind::GAMMA, currentNode->getOffset());
+        gamma_node->addChild(tree.identifierNode(static_cast<int>(Builtin::Y_STAR), currentNode->getOffset()));
+        gamma_node->addChild(eq_node);
 
-            // Modify the new_lambda_node
-            new_lambda_node->addChild(first_eq_node->getChildren()[0]);
-            new_lambda_node->addChild(second_eq_node->getChildren()[1]);
+        currentNode->setKind(NodeKind::EQUALS);
+        currentNode->setChild(0, var_node);
+        currentNode->addChild(gamma_node);
+        return currentNode;
+    }
 
-            root_node = new_eq_node; // Assign new_eq_node as the new root node
-        }
-        else
-        {
-            throw runtime_error("Error: within node must have 2 children.");
-        }
+    default:
+        // tau, ->, not, neg, the binary operators and the leaves are already standard
+        return currentNode;
     }
-    else if (currentNode->getLabel() == "not" || currentNode->getLabel() == "neg")
+}
+
+// name the function a definition binds to symbol: the value itself when it is a lambda, the
+// lambda under Y* for rec, and the curried lambdas of its body
+static void nameValue(TreeNode *value, int symbol)
+{
+    if (value->getKind() == NodeKind::GAMMA && value->getNumChildren() == 2 &&
+        value->getChildren()[0]->getKind() == NodeKind::IDENTIFIER &&
+        value->getChildren()[0]->getSymbol() == static_cast<int>(Builtin::Y_STAR))
     {
-        root_node = currentNode;
+        value = value->getChildren()[1];
     }
-    else if (find(binaryOperators.begin(), binaryOperators.end(), currentNode->getLabel()) !=
-             binaryOperators.end())
+
+    while (value->getKind() == NodeKind::LAMBDA && value->getSymbol() < 0)
     {
-        root_node = currentNode;
+        value->setSymbol(symbol);
+        value = value->getChildren()[1];
     }
-    else if (currentNode->getLabel() == "@")
-    {
-        if (currentNode->getNumChildren() == 3)
-        {
-            vector<TreeNode *> children = currentNode->getChildren();
-
-            TreeNode *first_gamma_node = new InternalNode("gamma");
-            TreeNode *second_gamma_node = new InternalNode("gamma");
-
-            // Make first_gamma_node
-            first_gamma_node->addChild(second_gamma_node);
-            first_gamma_node->addChild(children[2]);
+}
 
-            // Make second_gamma_node
-            second_gamma_node->addChild(children[1]);
-            second_gamma_node->addChild(children[0]);
+// Definitions are applications of a lambda binding their names: gamma(lambda(X, E), value),
+// or gamma(lambda(,(X1..Xn), E), tau(value1..valuen)) for simultaneous ones
+void nameLambdas(TreeNode *root)
+{
+    vector<TreeNode *> pending = {root};
 
-            root_node = first_gamma_node; // Assign first_gamma_node as the new root node
-        }
-        else
-        {
-            throw runtime_error("Error: @ node must have 3 children.");
-        }
-    }
-    else if (currentNode->getLabel() == "and")
+    while (!pending.empty())
     {
-        if (currentNode->getNumChildren() >= 2)
-        {
-            vector<TreeNode *> children = currentNode->getChildren();
-
-            TreeNode *eq_node = new InternalNode("=");
-            TreeNode *comma_node = new InternalNode(",");
-            TreeNode *tau_node = new InternalNode("tau");
+        TreeNode *node = pending.back();
+        pending.pop_back();
 
-            // Make eq_node and its children
-            eq_node->addChild(comma_node);
-            eq_node->addChild(tau_node);
+        if (node->getKind() == NodeKind::GAMMA && node->getNumChildren() == 2 &&
+            node->getChildren()[0]->getKind() == NodeKind::LAMBDA)
+        {
+            TreeNode *binder = node->getChildren()[0]->getChildren()[0];
+            TreeNode *value = node->getChildren()[1];
 
-            // Iterate children and modify comma_node and tau_node
-            for (TreeNode *child : children)
+            if (binder->getKind() == NodeKind::IDENTIFIER)
             {
-                comma_node->addChild(child->getChildren()[0]);
-                tau_node->addChild(child->getChildren()[1]);
+                nameValue(value, binder->getSymbol());
+            }
+            else if (binder->getKind() == NodeKind::COMMA && value->getKind() == NodeKind::TAU &&
+                     value->getNumChildren() == binder->getNumChildren())
+            {
+                for (int i = 0; i < binder->getNumChildren(); i++)
+                {
+                    nameValue(value->getChildren()[i], binder->getChildren()[i]->getSymbol());
+                }
             }
-
-            root_node = eq_node; // Assign eq_node as the new root node
         }
-        else
+
+        for (TreeNode *child : node->getChildren())
         {
-            throw runtime_error("Error: and node must have at least 2 children.");
+            pending.push_back(child);
         }
     }
-    else if (currentNode->getLabel() == "->")
-    {
-        root_node = currentNode;
-    }
-    else if (currentNode->getLabel() == "rec")
-    {
-        if (currentNode->getNumChildren() == 1)
-        {
-            TreeNode *eq_node = currentNode->getChildren()[0];
-            TreeNode *var_node = eq_node->getChildren()[0];
-            TreeNode *expr_node = eq_node->getChildren()[1];
-
-            TreeNode *new_eq_node = new InternalNode("=");
-
-            new_eq_node->addChild(var_node);
+}
 
-            TreeNode *new_gamma_node = new InternalNode("gamma");
-            TreeNode *new_lambda_node = new InternalNode("lambda");
-            TreeNode *y_str_node = new LeafNode("identifier", "Y*");
+// Standardize the tree in post-order without recursion, so deep trees cannot overflow the
+// native stack; each node is visited once and its children are replaced in place.
+TreeNode *generateST(Tree &tree, TreeNode *root)
+{
+    struct Frame
+    {
+        TreeNode *node;
+        int next; // next child to standardize
+    };
 
-            new_gamma_node->addChild(y_str_node);
-            new_gamma_node->addChild(new_lambda_node);
+    vector<Frame> pending = {{root, 0}};
 
-            new_lambda_node->addChild(var_node);
-            new_lambda_node->addChild(expr_node);
+    while (true)
+    {
+        Frame &frame = pending.back();
 
-            new_eq_node->addChild(new_gamma_node);
+        if (frame.next < frame.node->getNumChildren())
+        {
+            TreeNode *child = frame.node->getChildren()[frame.next++];
+            pending.push_back({child, 0});
+            continue;
+        }
 
-            delete eq_node;
+        TreeNode *standardized = standardizeNode(tree, frame.node);
+        pending.pop_back();
 
-            root_node = new_eq_node;
-        }
-        else
+        if (pending.empty())
         {
-            throw runtime_error("Error: rec node must have 1 child.");
+            return standardized;
         }
-    }
-    else
-    {
-        root_node = currentNode;
-    }
-    if (parentNode == nullptr)
-    {
-        // If parentNode is null, set root_node as new syntax tree root
-        Tree::getInstance().setSTRoot(root_node);
-        return;
-    }
-    else
-    {
-        // If parentNode is not null, add  root_node as a child of parentNode
-        parentNode->addChild(root_node);
-    }
 
-    if (root_node != currentNode)
-    {
-        delete currentNode; // Delete previous currentNode to free memory
+        Frame &parent = pending.back();
+        parent.node->setChild(parent.next - 1, standardized);
     }
 }